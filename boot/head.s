@@ -12,7 +12,7 @@
  * the page directory.
  */
 .text
-.globl _idt,_gdt,_pg_dir,_tmp_floppy_area
+.globl _idt,_gdt,_pg_dir,_tmp_floppy_area,_trampoline
 _pg_dir:
 ! 将其他寄存器从实模式转变为保护模式 
 startup_32:
@@ -109,8 +109,9 @@ setup_gdt:
 
 /*
  * I put the kernel page tables right after the page directory,
- * using 4 of them to span 16 Mb of physical memory. People with
- * more than 16MB will have to expand this.
+ * using 4 of them to span 16 Mb of physical memory. The ones for
+ * memory above that are in the bss (pg_more), so they don't make
+ * the image any larger.
  */
 .org 0x1000
 pg0:
@@ -133,6 +134,9 @@ pg3:
 _tmp_floppy_area:
 	.fill 1024,1,0
 
+/* 12 page tables for 16-64Mb, and a page to align them with */
+.lcomm pg_more,13*4096
+
 after_page_tables:
 	pushl $0		# These are the parameters to main :-)
 	pushl $0
@@ -186,14 +190,13 @@ ignore_int:
  * will be mapped to some other place - mm keeps track of
  * that.
  *
- * For those with more memory than 16 Mb - tough luck. I've
- * not got it, why should you :-) The source is here. Change
- * it. (Seriously - it shouldn't be too difficult. Mostly
- * change some constants etc. I left it at 16Mb, as my machine
- * even cannot be extended past that (ok, but it was cheap :-)
- * I've tried to show which constants to change by having
- * some kind of marker at them (search for "16Mb"), but I
- * won't guarantee that's all :-( )
+ * Memory above 16Mb is mapped as well, as far as the extended
+ * memory size from setup.s goes, up to 64Mb: the processes get
+ * the linear space above that, each with a page directory of its
+ * own that shares these tables (and 64Mb is as much as the bios
+ * call in setup.s can tell us about anyway).
+ * The kernel segments in the gdt are 64Mb to match, and main()
+ * doesn't use any more than that.
  */
 .align 2
 setup_paging:
@@ -211,7 +214,30 @@ setup_paging:
 1:	stosl			/* fill pages backwards - more efficient :-) */
 	subl $0x1000,%eax
 	jge 1b
-	xorl %eax,%eax		/* pg_dir is at 0x0000 */
+	cld
+	movzwl 0x90002,%ecx	/* extended memory (kB), from setup.s */
+	addl $1024+4095,%ecx	/* + the first Mb, in 4Mb page tables */
+	shrl $12,%ecx
+	cmpl $16,%ecx		/* 64Mb at most */
+	jbe 2f
+	movl $16,%ecx
+2:	subl $4,%ecx		/* pg0-pg3 are done */
+	jle 4f
+	movl $pg_more+4095,%edi
+	andl $0xfffff000,%edi
+	movl $_pg_dir+16,%ebx
+	movl $0x1000007,%eax	/* 16Mb + 7 */
+3:	leal 7(%edi),%edx
+	movl %edx,(%ebx)	/* page dir entry */
+	addl $4,%ebx
+	movl $1024,%edx
+5:	stosl
+	addl $0x1000,%eax
+	decl %edx
+	jne 5b
+	decl %ecx
+	jne 3b
+4:	xorl %eax,%eax		/* pg_dir is at 0x0000 */
 	movl %eax,%cr3		/* cr3 - page directory start */
 	movl %cr0,%eax
 	orl $0x80000000,%eax
@@ -233,7 +259,47 @@ gdt_descr:
 _idt:	.fill 256,8,0		# idt is uninitialized
 
 _gdt:	.quad 0x0000000000000000	/* NULL descriptor */
-	.quad 0x00c09a0000000fff	/* 16Mb */
-	.quad 0x00c0920000000fff	/* 16Mb */
+	.quad 0x00c09a0000003fff	/* 64Mb */
+	.quad 0x00c0920000003fff	/* 64Mb */
 	.quad 0x0000000000000000	/* TEMPORARY - don't use */
 	.fill 252,8,0			/* space for LDT's and TSS's etc */
+
+/*
+ * The other cpus start here, in real mode at _trampoline:0 (see
+ * smp_boot() in kernel/smp.c), which must be on a page boundary
+ * below 1MB. We get to protected mode with the gdt above, and then
+ * take over the paging and cr4 of the boot cpu, the stack of our
+ * idle task and the idt, and are off to start_secondary(). as86
+ * syntax doesn't mix with this file, so the 16-bit code is bytes.
+ */
+.org 0x7000
+_trampoline:
+	.byte 0xfa			/* cli */
+	.byte 0x31,0xc0			/* xorw %ax,%ax */
+	.byte 0x8e,0xd8			/* movw %ax,%ds */
+	.byte 0x66,0x0f,0x01,0x16	/* lgdtl gdt_descr */
+	.word gdt_descr
+	.byte 0x0f,0x20,0xc0		/* movl %cr0,%eax */
+	.byte 0x0c,0x01			/* orb $1,%al (PE) */
+	.byte 0x0f,0x22,0xc0		/* movl %eax,%cr0 */
+	.byte 0x66,0xea			/* ljmpl $0x08,$ap_startup */
+	.long ap_startup
+	.word 0x08
+.align 2
+ap_startup:
+	movl $0x10,%eax
+	mov %ax,%ds
+	mov %ax,%es
+	mov %ax,%fs
+	mov %ax,%gs
+	mov %ax,%ss
+	movl _ap_stack,%esp
+	movl _smp_cr4,%eax
+	.byte 0x0f,0x22,0xe0		/* movl %eax,%cr4 */
+	xorl %eax,%eax			/* pg_dir is at 0x0000 */
+	movl %eax,%cr3
+	movl _smp_cr0,%eax		/* paging (PG) and the rest */
+	movl %eax,%cr0
+	lidt idt_descr
+	call _start_secondary
+1:	jmp 1b
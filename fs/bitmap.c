@@ -55,9 +55,9 @@ void free_block(int dev, int block)
 		panic("trying to free block not in datazone");
 	bh = get_hash_table(dev,block);
 	if (bh) {
-		if (bh->b_count != 1) {
+		if (atomic_read(&bh->b_count) != 1) {
 			printk("trying to free block (%04x:%d), count=%d\n",
-				dev,block,bh->b_count);
+				dev,block,atomic_read(&bh->b_count));
 			return;
 		}
 		bh->b_dirt=0;
@@ -95,7 +95,7 @@ int new_block(int dev)
 		return 0;
 	if (!(bh=getblk(dev,j)))
 		panic("new_block: cannot get block");
-	if (bh->b_count != 1)
+	if (atomic_read(&bh->b_count) != 1)
 		panic("new block: count is != 1");
 	clear_block(bh->b_data);
 	bh->b_uptodate = 1;
@@ -115,8 +115,8 @@ void free_inode(struct m_inode * inode)
 		memset(inode,0,sizeof(*inode));
 		return;
 	}
-	if (inode->i_count>1) {
-		printk("trying to free inode with count=%d\n",inode->i_count);
+	if (atomic_read(&inode->i_count)>1) {
+		printk("trying to free inode with count=%d\n",atomic_read(&inode->i_count));
 		panic("free_inode");
 	}
 	if (inode->i_nlinks)
@@ -156,7 +156,7 @@ struct m_inode * new_inode(int dev)
 	if (set_bit(j,bh->b_data))
 		panic("new_inode: bit already set");
 	bh->b_dirt = 1;
-	inode->i_count=1;
+	atomic_set(&inode->i_count,1);
 	inode->i_nlinks=1;
 	inode->i_dev=dev;
 	inode->i_uid=current->euid;
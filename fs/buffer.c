@@ -8,8 +8,9 @@
  *  'buffer.c' implements the buffer-cache functions. Race-conditions have
  * been avoided by NEVER letting a interrupt change a buffer (except for the
  * data, of course), but instead letting the caller do it. NOTE! As interrupts
- * can wake up a caller, some cli-sti sequences are needed to check for
- * sleep-on-calls. These should be extremely quick, though (I hope).
+ * can wake up a caller, the checks for sleep-on-calls are done holding
+ * buffer_lock, with interrupts off. These should be extremely quick,
+ * though (I hope).
  */
 
 /*
@@ -19,26 +20,75 @@
  */
 
 #include <stdarg.h>
+#include <errno.h>
  
 #include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
 #include <asm/io.h>
+#include <asm/segment.h>
+#include <sys/bufstat.h>
+
+/*
+ * Unused buffers are kept on lru-lists, least recently used first, so
+ * that getblk() can take a reusable buffer off the head of BUF_CLEAN
+ * without looking at the rest of the cache. BUF_DIRTY holds the unused
+ * buffers that still have to be written out (or are locked for I/O),
+ * and BUF_USED the ones somebody has a reference to. Buffers change
+ * lists only through refile_buffer(), called when b_count changes.
+ * b_count itself is atomic, but the lists are still looked after by
+ * the kernel lock.
+ * Interrupts never touch the lists, so a buffer may be out of date on
+ * its list (a write has finished, say): getblk() refiles those when it
+ * runs into them.
+ */
+#define BUF_CLEAN	0
+#define BUF_DIRTY	1
+#define BUF_USED	2
+#define NR_LIST		3
 
 extern int end;
-struct buffer_head * start_buffer = (struct buffer_head *) &end;
-struct buffer_head * hash_table[NR_HASH];
-static struct buffer_head * free_list;
-static struct task_struct * buffer_wait = NULL;
+struct buffer_head * start_buffer;
+struct buffer_head ** hash_table;
+static int hash_shift;
+static struct buffer_head * lru_list[NR_LIST] = {NULL,NULL,NULL};
+static int nr_buffers_type[NR_LIST] = {0,0,0};
+struct wait_queue * buffer_wait = NULL;	/* woken when a buffer gets clean */
+static struct wait_queue * bdflush_wait = NULL;
+static int bdflush_running = 0;
+static int bdflush_wanted = 0;		/* getblk() found no clean buffer */
+static struct bufstat buffer_stats;
+spinlock_t buffer_lock = SPIN_LOCK_UNLOCKED("buffer");
 int NR_BUFFERS = 0;
+int NR_HASH = 0;
+
+/*
+ * Tunables for the buffer flusher, see sys_bdflush(). bdflush wakes up
+ * every 'interval' ticks and writes the buffers that have been dirty
+ * for more than 'age' ticks, or right away when more than 'nfract'
+ * percent of the cache is dirty. At most 'ndirty' buffers are queued
+ * per round.
+ */
+#define BDFLUSH_BATCH	64
+
+static struct {
+	int nfract;
+	int ndirty;
+	int interval;
+	int age;
+} bdf_prm = {40, 32, 5*HZ, 30*HZ};
+
+#define NR_BDF_PRM (sizeof(bdf_prm)/sizeof(int))
 
 static inline void wait_on_buffer(struct buffer_head * bh)
 {
-	cli();
+	unsigned long flags;
+
+	spin_lock_irqsave(&buffer_lock,flags);
 	while (bh->b_lock)
-		sleep_on(&bh->b_wait);
-	sti();
+		sleep_on_locked(&bh->b_wait,&buffer_lock);
+	spin_unlock_irqrestore(&buffer_lock,flags);
 }
 
 int sys_sync(void)
@@ -125,9 +175,76 @@ void check_disk_change(int dev)
 	invalidate_buffers(dev);
 }
 
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+/*
+ * Multiplicative hashing: the (dev,block) pair is multiplied by a
+ * constant close to 2^32/phi, and the top bits are the chain number.
+ * Sequential block numbers spread out evenly over the table, unlike
+ * with the old (dev^block)%NR_HASH.
+ */
+#define _hashfn(dev,block) \
+((((((unsigned)(dev))<<16) ^ (unsigned)(block)) * 0x9e3779b1) >> hash_shift)
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
+static inline void remove_from_lru(struct buffer_head * bh)
+{
+	if (!(bh->b_prev_free) || !(bh->b_next_free))
+		panic("Free block list corrupted");
+	nr_buffers_type[bh->b_list]--;
+	if (bh->b_next_free == bh)
+		lru_list[bh->b_list] = NULL;
+	else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		if (lru_list[bh->b_list] == bh)
+			lru_list[bh->b_list] = bh->b_next_free;
+	}
+	bh->b_next_free = bh->b_prev_free = NULL;
+}
+
+static inline void put_last_lru(struct buffer_head * bh, int list)
+{
+	bh->b_list = list;
+	nr_buffers_type[list]++;
+	if (!lru_list[list]) {
+		lru_list[list] = bh;
+		bh->b_prev_free = bh->b_next_free = bh;
+		return;
+	}
+	bh->b_next_free = lru_list[list];
+	bh->b_prev_free = lru_list[list]->b_prev_free;
+	lru_list[list]->b_prev_free->b_next_free = bh;
+	lru_list[list]->b_prev_free = bh;
+}
+
+#define LRU_LIST(bh) (atomic_read(&(bh)->b_count) ? BUF_USED : \
+	(((bh)->b_dirt || (bh)->b_lock) ? BUF_DIRTY : BUF_CLEAN))
+
+/*
+ * Put the buffer at the end of the list matching its current state.
+ * Also done when the list doesn't change, which keeps the lru order.
+ */
+static void refile_buffer(struct buffer_head * bh)
+{
+	int list = LRU_LIST(bh);
+
+	remove_from_lru(bh);
+	put_last_lru(bh,list);
+	if (!bh->b_dirt)
+		bh->b_flushtime = 0;
+	else if (!bh->b_flushtime)
+		bh->b_flushtime = jiffies + bdf_prm.age;
+	if (list == BUF_CLEAN)
+		wake_up(&buffer_wait);
+	else if (list == BUF_DIRTY) {
+		if (bdflush_wanted ||
+		    nr_buffers_type[BUF_DIRTY]*100 > bdf_prm.nfract*NR_BUFFERS)
+			wake_up(&bdflush_wait);
+/* with no bdflush, getblk() queues the writes itself when woken */
+		if (bdflush_wanted && !bdflush_running)
+			wake_up(&buffer_wait);
+	}
+}
+
 static inline void remove_from_queues(struct buffer_head * bh)
 {
 /* remove from hash-queue */
@@ -137,22 +254,14 @@ static inline void remove_from_queues(struct buffer_head * bh)
 		bh->b_prev->b_next = bh->b_next;
 	if (hash(bh->b_dev,bh->b_blocknr) == bh)
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
-/* remove from free list */
-	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
+/* remove from lru list */
+	remove_from_lru(bh);
 }
 
 static inline void insert_into_queues(struct buffer_head * bh)
 {
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
+/* put at end of its lru list */
+	put_last_lru(bh,LRU_LIST(bh));
 /* put the buffer in new hash-queue if it has a device */
 	bh->b_prev = NULL;
 	bh->b_next = NULL;
@@ -187,14 +296,51 @@ struct buffer_head * get_hash_table(int dev, int block)
 	for (;;) {
 		if (!(bh=find_buffer(dev,block)))
 			return NULL;
-		bh->b_count++;
+		atomic_inc(&bh->b_count);
+		if (atomic_read(&bh->b_count) == 1)
+			refile_buffer(bh);
 		wait_on_buffer(bh);
 		if (bh->b_dev == dev && bh->b_blocknr == block)
 			return bh;
-		bh->b_count--;
+		if (atomic_dec_and_test(&bh->b_count))
+			refile_buffer(bh);
+	}
+}
+
+/*
+ * get_free_buffer() returns the least recently used clean unreferenced
+ * buffer, or NULL if there is none. Normally that is just the head of
+ * the clean list: anything else found there is moved to the list it
+ * belongs on, so each stale entry costs one look only. The dirty list
+ * is walked only when no clean buffer is left, to pick up buffers
+ * that have been written out since they were filed.
+ */
+static struct buffer_head * get_free_buffer(int * scanned)
+{
+	struct buffer_head * bh, * tmp;
+	int n;
+
+	while (bh = lru_list[BUF_CLEAN]) {
+		(*scanned)++;
+		if (LRU_LIST(bh) == BUF_CLEAN)
+			return bh;
+		refile_buffer(bh);
 	}
+	if (bh = lru_list[BUF_DIRTY]) {
+		n = nr_buffers_type[BUF_DIRTY];
+		do {
+			tmp = bh;
+			bh = bh->b_next_free;
+			(*scanned)++;
+			if (LRU_LIST(tmp) != BUF_DIRTY)
+				refile_buffer(tmp);
+		} while (--n > 0);
+	}
+	return lru_list[BUF_CLEAN];
 }
 
+static void flush_buffers(void);
+
 /*
  * Ok, this is getblk, and it isn't very clear, again to hinder
  * race-conditions. Most of the code is seldom used, (ie repeating),
@@ -202,51 +348,57 @@ struct buffer_head * get_hash_table(int dev, int block)
  *
  * The algoritm is changed: hopefully better, and an elusive bug removed.
  */
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
 struct buffer_head * getblk(int dev,int block)
 {
-	struct buffer_head * tmp, * bh;
+	struct buffer_head * bh;
+	unsigned long flags;
+	int scanned = 0, slept = 0;
 
 repeat:
-	if (bh = get_hash_table(dev,block))
+	if (bh = get_hash_table(dev,block)) {
+/* we were woken for a free buffer we don't need: pass it on */
+		if (slept)
+			wake_up(&buffer_wait);
+		buffer_stats.bs_hits++;
 		return bh;
-	tmp = free_list;
-	do {
-		if (tmp->b_count)
-			continue;
-		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp))
-				break;
-		}
-/* and repeat until we find something good */
-	} while ((tmp = tmp->b_next_free) != free_list);
-	if (!bh) {
-		sleep_on(&buffer_wait);
-		goto repeat;
 	}
-	wait_on_buffer(bh);
-	if (bh->b_count)
+/*
+ * No clean buffer left: have bdflush write some (or queue the writes
+ * ourselves if there is no bdflush), and wait for one to be refiled or
+ * written. The check is done again under buffer_lock, which the end of
+ * a write wakes us under, so that the wake-up can't be missed.
+ */
+	if (!(bh = get_free_buffer(&scanned))) {
+		bdflush_wanted = 1;
+		if (bdflush_running)
+			wake_up(&bdflush_wait);
+		else
+			flush_buffers();
+		spin_lock_irqsave(&buffer_lock,flags);
+		if (!get_free_buffer(&scanned))
+			sleep_on_exclusive_locked(&buffer_wait,&buffer_lock);
+		spin_unlock_irqrestore(&buffer_lock,flags);
+		slept = 1;
 		goto repeat;
-	while (bh->b_dirt) {
-		sync_dev(bh->b_dev);
-		wait_on_buffer(bh);
-		if (bh->b_count)
-			goto repeat;
 	}
-/* NOTE!! While we slept waiting for this block, somebody else might */
+/* NOTE!! If we slept on the way here, somebody else might */
 /* already have added "this" block to the cache. check it */
 	if (find_buffer(dev,block))
 		goto repeat;
 /* OK, FINALLY we know that this buffer is the only one of it's kind, */
 /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
-	bh->b_count=1;
+	atomic_set(&bh->b_count,1);
 	bh->b_dirt=0;
 	bh->b_uptodate=0;
+	bh->b_flushtime=0;
 	remove_from_queues(bh);
 	bh->b_dev=dev;
 	bh->b_blocknr=block;
 	insert_into_queues(bh);
+	buffer_stats.bs_misses++;
+	buffer_stats.bs_scanned += scanned;
+	if (scanned > buffer_stats.bs_max_scan)
+		buffer_stats.bs_max_scan = scanned;
 	return bh;
 }
 
@@ -255,9 +407,10 @@ void brelse(struct buffer_head * buf)
 	if (!buf)
 		return;
 	wait_on_buffer(buf);
-	if (!(buf->b_count--))
+	if (!atomic_read(&buf->b_count))
 		panic("Trying to free free buffer");
-	wake_up(&buffer_wait);
+	if (atomic_dec_and_test(&buf->b_count))
+		refile_buffer(buf);
 }
 
 /*
@@ -287,16 +440,24 @@ __asm__("cld\n\t" \
 	::"c" (BLOCK_SIZE/4),"S" (from),"D" (to) \
 	:"cx","di","si")
 
+#define CLEARBLK(to) \
+__asm__("cld\n\t" \
+	"rep\n\t" \
+	"stosl\n\t" \
+	::"a" (0),"c" (BLOCK_SIZE/4),"D" (to) \
+	:"cx","di")
+
 /*
  * bread_page reads four buffers into memory at the desired address. It's
  * a function of its own, as there is some speed to be got by reading them
  * all at the same time, not waiting for one to be read, and then another
- * etc.
+ * etc. Blocks that are 0 (holes) or can't be read are cleared, so the
+ * page needn't be beforehand. Returns 0 if a block couldn't be read.
  */
-void bread_page(unsigned long address,int dev,int b[4])
+int bread_page(unsigned long address,int dev,int b[4])
 {
 	struct buffer_head * bh[4];
-	int i;
+	int i, ok = 1;
 
 	for (i=0 ; i<4 ; i++)
 		if (b[i]) {
@@ -310,8 +471,31 @@ void bread_page(unsigned long address,int dev,int b[4])
 			wait_on_buffer(bh[i]);
 			if (bh[i]->b_uptodate)
 				COPYBLK((unsigned long) bh[i]->b_data,address);
+			else {
+				CLEARBLK(address);
+				ok = 0;
+			}
 			brelse(bh[i]);
-		}
+		} else
+			CLEARBLK(address);
+	return ok;
+}
+
+/*
+ * reada_block() starts reading a block if it isn't in the cache yet,
+ * without waiting for it. If the request queue is full it's just
+ * forgotten about.
+ */
+void reada_block(int dev,int block)
+{
+	struct buffer_head * bh;
+
+	if (!(bh=getblk(dev,block)))
+		return;
+	if (!bh->b_uptodate)
+		ll_rw_block(READA,bh);
+	if (atomic_dec_and_test(&bh->b_count))
+		refile_buffer(bh);
 }
 
 /*
@@ -322,21 +506,15 @@ void bread_page(unsigned long address,int dev,int b[4])
 struct buffer_head * breada(int dev,int first, ...)
 {
 	va_list args;
-	struct buffer_head * bh, *tmp;
+	struct buffer_head * bh;
 
 	va_start(args,first);
 	if (!(bh=getblk(dev,first)))
 		panic("bread: getblk returned NULL\n");
 	if (!bh->b_uptodate)
 		ll_rw_block(READ,bh);
-	while ((first=va_arg(args,int))>=0) {
-		tmp=getblk(dev,first);
-		if (tmp) {
-			if (!tmp->b_uptodate)
-				ll_rw_block(READA,bh);
-			tmp->b_count--;
-		}
-	}
+	while ((first=va_arg(args,int))>=0)
+		reada_block(dev,first);
 	va_end(args);
 	wait_on_buffer(bh);
 	if (bh->b_uptodate)
@@ -347,7 +525,7 @@ struct buffer_head * breada(int dev,int first, ...)
 
 void buffer_init(long buffer_end)
 {
-	struct buffer_head * h = start_buffer;
+	struct buffer_head * h;
 	void * b;
 	int i;
 
@@ -355,27 +533,174 @@ void buffer_init(long buffer_end)
 		b = (void *) (640*1024);
 	else
 		b = (void *) buffer_end;
-	while ( (b -= BLOCK_SIZE) >= ((void *) (h+1)) ) {
+/*
+ * The hash table goes in front of the buffer heads. It gets a power of
+ * two number of chains, about one for every two buffers, estimated from
+ * the memory we have (ignoring the 640k-1M hole, so it errs on the
+ * large side). The heads themselves have to stay below 640k, whatever
+ * the buffer memory above 1M, see main().
+ */
+	i = ((long) b - (long) &end) / BLOCK_SIZE;
+	NR_HASH = 16;
+	hash_shift = 32-4;
+	while (NR_HASH < i/2) {
+		NR_HASH <<= 1;
+		hash_shift--;
+	}
+	hash_table = (struct buffer_head **) &end;
+	h = start_buffer = (struct buffer_head *) (hash_table + NR_HASH);
+	while ( (b -= BLOCK_SIZE) >= ((void *) (h+1)) &&
+		(void *) (h+1) <= (void *) 0xA0000 ) {
 		h->b_dev = 0;
 		h->b_dirt = 0;
-		h->b_count = 0;
+		atomic_set(&h->b_count,0);
 		h->b_lock = 0;
 		h->b_uptodate = 0;
+		h->b_flushtime = 0;
 		h->b_wait = NULL;
 		h->b_next = NULL;
 		h->b_prev = NULL;
+		h->b_reqnext = NULL;
 		h->b_data = (char *) b;
-		h->b_prev_free = h-1;
-		h->b_next_free = h+1;
+		put_last_lru(h,BUF_CLEAN);
 		h++;
 		NR_BUFFERS++;
 		if (b == (void *) 0x100000)
 			b = (void *) 0xA0000;
 	}
-	h--;
-	free_list = start_buffer;
-	free_list->b_prev_free = h;
-	h->b_next_free = free_list;
 	for (i=0;i<NR_HASH;i++)
 		hash_table[i]=NULL;
+}
+
+int sys_bufstat(struct bufstat * buf)
+{
+	struct buffer_head * bh;
+	int i, len;
+
+	if (!buf)
+		return -EINVAL;
+	verify_area(buf,sizeof *buf);
+	buffer_stats.bs_buffers = NR_BUFFERS;
+	buffer_stats.bs_clean = nr_buffers_type[BUF_CLEAN];
+	buffer_stats.bs_dirty = nr_buffers_type[BUF_DIRTY];
+	buffer_stats.bs_used = nr_buffers_type[BUF_USED];
+	buffer_stats.bs_nr_hash = NR_HASH;
+	buffer_stats.bs_max_chain = 0;
+	for (i=0 ; i<BUFSTAT_CHAINS ; i++)
+		buffer_stats.bs_chain[i] = 0;
+	for (i=0 ; i<NR_HASH ; i++) {
+		for (len=0, bh=hash_table[i] ; bh ; bh=bh->b_next)
+			len++;
+		if (len > buffer_stats.bs_max_chain)
+			buffer_stats.bs_max_chain = len;
+		if (len >= BUFSTAT_CHAINS)
+			len = BUFSTAT_CHAINS-1;
+		buffer_stats.bs_chain[len]++;
+	}
+	for (i=0 ; i<sizeof *buf ; i++)
+		put_fs_byte(((char *) &buffer_stats)[i],i+(char *) buf);
+	return 0;
 }	
+
+/*
+ * flush_buffers() queues writes for the unused dirty buffers that are
+ * old enough, or for any of them if too much of the cache is dirty or
+ * getblk() has run out of clean ones. bdflush_wanted stays set until
+ * a write has been queued: until then, a buffer that is released dirty
+ * wakes the flusher (see refile_buffer()), so getblk() isn't left
+ * waiting for the next interval.
+ * The buffers are picked first and held while being written, as
+ * ll_rw_block() may sleep and the lists can change under us.
+ */
+static void flush_buffers(void)
+{
+	struct buffer_head * bh, * tmp, * batch[BDFLUSH_BATCH];
+	int i, n, nr = 0, force;
+
+	if (!(bh = lru_list[BUF_DIRTY]))
+		return;
+	force = bdflush_wanted ||
+		nr_buffers_type[BUF_DIRTY]*100 > bdf_prm.nfract*NR_BUFFERS;
+	n = nr_buffers_type[BUF_DIRTY];
+	do {
+		tmp = bh;
+		bh = bh->b_next_free;
+		if (LRU_LIST(tmp) != BUF_DIRTY) {
+			refile_buffer(tmp);
+			continue;
+		}
+		if (!tmp->b_dirt || tmp->b_lock)
+			continue;
+		if (!force && tmp->b_flushtime > jiffies)
+			continue;
+		atomic_inc(&tmp->b_count);
+		refile_buffer(tmp);
+		batch[nr++] = tmp;
+	} while (--n > 0 && nr < bdf_prm.ndirty);
+	if (nr)
+		bdflush_wanted = 0;
+	for (i=0 ; i<nr ; i++) {
+		ll_rw_block(WRITE,batch[i]);
+		if (atomic_dec_and_test(&batch[i]->b_count))
+			refile_buffer(batch[i]);
+	}
+}
+
+static void bdflush_timeout(unsigned long unused)
+{
+	wake_up(&bdflush_wait);
+}
+
+static struct timer_list bdflush_timer = {
+	NULL, NULL, 0, bdflush_timeout, 0 };
+
+/*
+ * sys_bdflush() is the buffer flusher. func 0 turns the caller into the
+ * flush daemon (init starts one at boot), which only returns when it
+ * gets a signal. func 1 does one flush round. For func >= 2, parameter
+ * (func-2)>>1 is read into *data when func is even, and set to data
+ * when it is odd.
+ */
+int sys_bdflush(int func, long data)
+{
+	int i;
+
+	if (func == 1) {
+		flush_buffers();
+		return 0;
+	}
+	if (func >= 2) {
+		i = (func-2) >> 1;
+		if (i >= NR_BDF_PRM)
+			return -EINVAL;
+		if (!(func & 1)) {
+			verify_area((void *) data,4);
+			put_fs_long(((int *) &bdf_prm)[i],(unsigned long *) data);
+			return 0;
+		}
+		if (!suser())
+			return -EPERM;
+		if (data <= 0 || (i == 0 && data > 100) ||
+		    (i == 1 && data > BDFLUSH_BATCH))
+			return -EINVAL;
+		((int *) &bdf_prm)[i] = data;
+		return 0;
+	}
+	if (func)
+		return -EINVAL;
+	if (!suser())
+		return -EPERM;
+	if (bdflush_running)
+		return -EBUSY;
+	bdflush_running = 1;
+	for (;;) {
+		flush_buffers();
+		if (!timer_pending(&bdflush_timer))
+			mod_timer(&bdflush_timer,jiffies+bdf_prm.interval);
+		interruptible_sleep_on(&bdflush_wait);
+		if (current->signal & ~current->blocked) {
+			bdflush_running = 0;
+			return -EINTR;
+		}
+	}
+}
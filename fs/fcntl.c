@@ -29,7 +29,7 @@ static int dupfd(unsigned int fd, unsigned int arg)
 	if (arg >= NR_OPEN)
 		return -EMFILE;
 	current->close_on_exec &= ~(1<<arg);
-	(current->filp[arg] = current->filp[fd])->f_count++;
+	atomic_inc(&(current->filp[arg] = current->filp[fd])->f_count);
 	return arg;
 }
 
@@ -14,15 +14,59 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+/*
+ * Read-ahead for sequential reads. f_ranext is the block a sequential
+ * reader would want next, f_raend the first block past what has been
+ * read ahead already, and f_rawin the size of the read-ahead window.
+ * The window starts at READA_MIN blocks and doubles, up to READA_MAX,
+ * each time it is refilled, which happens when the reader has used up
+ * half of it: that way there are always requests queued in front of
+ * the reader. Any non-sequential access shuts read-ahead off again.
+ */
+#define READA_MIN	4
+#define READA_MAX	16
+
+static void file_readahead(struct m_inode * inode, struct file * filp,
+	int block, int nr)
+{
+	int end;
+
+	if (block+1 == filp->f_ranext)
+		return;
+	if (block != filp->f_ranext) {
+		filp->f_ranext = filp->f_raend = block+1;
+		filp->f_rawin = 0;
+		return;
+	}
+	filp->f_ranext = block+1;
+	if (filp->f_raend > block+1+filp->f_rawin/2)
+		return;
+	if (!filp->f_rawin)
+		filp->f_rawin = READA_MIN;
+	else
+		filp->f_rawin = MIN(filp->f_rawin<<1,READA_MAX);
+	end = MIN(block+1+filp->f_rawin,
+		(inode->i_size+BLOCK_SIZE-1)/BLOCK_SIZE);
+	if (nr)
+		reada_block(inode->i_dev,nr);
+	for (block = MAX(filp->f_raend,block+1) ; block < end ; block++)
+		if (nr = bmap(inode,block))
+			reada_block(inode->i_dev,nr);
+	filp->f_raend = MAX(filp->f_raend,end);
+}
+
 int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
-	int left,chars,nr;
+	int left,chars,nr,block;
 	struct buffer_head * bh;
 
 	if ((left=count)<=0)
 		return 0;
 	while (left) {
-		if (nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE)) {
+		block = (filp->f_pos)/BLOCK_SIZE;
+		nr = bmap(inode,block);
+		file_readahead(inode,filp,block,nr);
+		if (nr) {
 			if (!(bh=bread(inode->i_dev,nr)))
 				break;
 		} else
@@ -14,6 +14,9 @@
 
 struct m_inode inode_table[NR_INODE]={{0,},};
 
+/* taken to change i_lock, and to wait for it to be cleared */
+spinlock_t inode_lock = SPIN_LOCK_UNLOCKED("inode");
+
 static void read_inode(struct m_inode * inode);
 static void write_inode(struct m_inode * inode);
 
@@ -21,27 +24,29 @@ static void write_inode(struct m_inode * inode);
 // 如果 i 节点已被锁定，则将当前任务置为不可中断的等待状态。直到该 i 节点解锁
 static inline void wait_on_inode(struct m_inode * inode)
 {
-	cli();
+	spin_lock(&inode_lock);
 	while (inode->i_lock)
-		sleep_on(&inode->i_wait);
-	sti();
+		sleep_on_locked(&inode->i_wait,&inode_lock);
+	spin_unlock(&inode_lock);
 }
 
 static inline void lock_inode(struct m_inode * inode)
 {
-	cli();
+	spin_lock(&inode_lock);
 	while (inode->i_lock)
-		sleep_on(&inode->i_wait);
+		sleep_on_exclusive_locked(&inode->i_wait,&inode_lock);
 	// 锁定节点
 	inode->i_lock=1;
-	sti();
+	spin_unlock(&inode_lock);
 }
 
 // 直接解锁节点，然后唤醒等待该节点的进程
 static inline void unlock_inode(struct m_inode * inode)
 {
+	spin_lock(&inode_lock);
 	inode->i_lock=0;
 	wake_up(&inode->i_wait);
+	spin_unlock(&inode_lock);
 }
 
 // 释放内存中设备 dev 的所有 i 节点。
@@ -57,7 +62,7 @@ void invalidate_inodes(int dev)
 		// 匹配指定设备
 		if (inode->i_dev == dev) {
 			// 节点引用次数不为0则显示出错
-			if (inode->i_count)
+			if (atomic_read(&inode->i_count))
 				printk("inode in use on removed disk\n\r");
 			// 释放节点
 			inode->i_dev = inode->i_dirt = 0;
@@ -184,24 +189,23 @@ void iput(struct m_inode * inode)
 		return;
 	// 等待i节点解锁
 	wait_on_inode(inode);
-	if (!inode->i_count)
+	if (!atomic_read(&inode->i_count))
 		panic("iput: trying to free free inode");
 	// 如果是管道 i 节点，则唤醒等待该管道的进程，引用次数减 1，如果还有引用则返回
 	// 否则释放管道占用的内存页面，并复位该节点的引用计数值、已修改标志和管道标志，并返回
 	// 管道节点比较特殊，是内存，也是文件，所以需要释放page(这里的i_size存放物理内存地址)，也要修改inode信息
 	if (inode->i_pipe) {
 		wake_up(&inode->i_wait);
-		if (--inode->i_count)
+		if (!atomic_dec_and_test(&inode->i_count))
 			return;
 		free_page(inode->i_size);
-		inode->i_count=0;
 		inode->i_dirt=0;
 		inode->i_pipe=0;
 		return;
 	}
 	// 如果 i 节点对应的设备号=0，则将此节点的引用计数递减 1，返回
 	if (!inode->i_dev) {
-		inode->i_count--;
+		atomic_dec(&inode->i_count);
 		return;
 	}
 	// 如果 i 节点对应的设备号=0，则将此节点的引用计数递减 1，返回
@@ -211,8 +215,8 @@ void iput(struct m_inode * inode)
 	}
 repeat:
 	// 如果 i 节点的引用计数大于 1，则递减 1
-	if (inode->i_count>1) {
-		inode->i_count--;
+	if (atomic_read(&inode->i_count)>1) {
+		atomic_dec(&inode->i_count);
 		return;
 	}
 	// 如果 i 节点的链接数为 0，则释放该 i 节点的所有逻辑块，并释放该 i 节点
@@ -227,7 +231,7 @@ repeat:
 		wait_on_inode(inode);
 		goto repeat;
 	}
-	inode->i_count--;
+	atomic_dec(&inode->i_count);
 	return;
 }
 
@@ -248,7 +252,7 @@ struct m_inode * get_empty_inode(void)
 			// 如果 last_inode 所指向的 i 节点的计数值为 0，则说明可能找到空闲 i 节点项
 			// 让 inode 指向该 i 节点
 			// 如果该 i 节点的已修改标志和锁定标志均为 0，则我们可以使用该 i 节点，退出循环
-			if (!last_inode->i_count) {
+			if (!atomic_read(&last_inode->i_count)) {
 				inode = last_inode;
 				if (!inode->i_dirt && !inode->i_lock)
 					break;
@@ -266,10 +270,10 @@ struct m_inode * get_empty_inode(void)
 			write_inode(inode);
 			wait_on_inode(inode);
 		}
-	} while (inode->i_count);
+	} while (atomic_read(&inode->i_count));
 	// 已找到空闲 i 节点项。则将该 i 节点项内容清零，并置引用标志为 1，返回该 i 节点指针
 	memset(inode,0,sizeof(*inode));
-	inode->i_count = 1;
+	atomic_set(&inode->i_count,1);
 	return inode;
 }
 
@@ -282,11 +286,11 @@ struct m_inode * get_pipe_inode(void)
 
 	if (!(inode = get_empty_inode()))
 		return NULL;
-	if (!(inode->i_size=get_free_page())) {
-		inode->i_count = 0;
+	if (!(inode->i_size=__get_free_page())) {
+		atomic_set(&inode->i_count,0);
 		return NULL;
 	}
-	inode->i_count = 2;	/* sum of readers/writers */
+	atomic_set(&inode->i_count,2);	/* sum of readers/writers */
 	// 这里对head指针和tail指针进行了初始化
 	PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
 	inode->i_pipe = 1;
@@ -315,7 +319,7 @@ struct m_inode * iget(int dev,int nr)
 			inode = inode_table;
 			continue;
 		}
-		inode->i_count++;
+		atomic_inc(&inode->i_count);
 		// 如果该 i 节点是其它文件系统的安装点，则在超级块表中搜寻安装在此 i 节点的超级块。如果没有
 		// 找到，则显示出错信息，并释放函数开始获取的空闲节点，返回该 i 节点指针
 		if (inode->i_mount) {
@@ -120,7 +120,7 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 			if (sb->s_imount) {
 				iput(*dir);
 				(*dir)=sb->s_imount;
-				(*dir)->i_count++;
+				atomic_inc(&(*dir)->i_count);
 			}
 		}
 	}
@@ -234,9 +234,9 @@ static struct m_inode * get_dir(const char * pathname)
 	int namelen,inr,idev;
 	struct dir_entry * de;
 
-	if (!current->root || !current->root->i_count)
+	if (!current->root || !atomic_read(&current->root->i_count))
 		panic("No root inode");
-	if (!current->pwd || !current->pwd->i_count)
+	if (!current->pwd || !atomic_read(&current->pwd->i_count))
 		panic("No cwd inode");
 	if ((c=get_fs_byte(pathname))=='/') {
 		inode = current->root;
@@ -245,7 +245,7 @@ static struct m_inode * get_dir(const char * pathname)
 		inode = current->pwd;
 	else
 		return NULL;	/* empty name is bad */
-	inode->i_count++;
+	atomic_inc(&inode->i_count);
 	while (1) {
 		thisname = pathname;
 		if (!S_ISDIR(inode->i_mode) || !permission(inode,MAY_EXEC)) {
@@ -621,7 +621,7 @@ int sys_rmdir(const char * name)
 		brelse(bh);
 		return -EPERM;
 	}
-	if (inode->i_dev != dir->i_dev || inode->i_count>1) {
+	if (inode->i_dev != dir->i_dev || atomic_read(&inode->i_count)>1) {
 		iput(dir);
 		iput(inode);
 		brelse(bh);
@@ -150,13 +150,13 @@ int sys_open(const char * filename,int flag,int mode)
 	current->close_on_exec &= ~(1<<fd);
 	f=0+file_table;
 	for (i=0 ; i<NR_FILE ; i++,f++)
-		if (!f->f_count) break;
+		if (!atomic_read(&f->f_count)) break;
 	if (i>=NR_FILE)
 		return -EINVAL;
-	(current->filp[fd]=f)->f_count++;
+	atomic_inc(&(current->filp[fd]=f)->f_count);
 	if ((i=open_namei(filename,flag,mode,&inode))<0) {
 		current->filp[fd]=NULL;
-		f->f_count=0;
+		atomic_set(&f->f_count,0);
 		return i;
 	}
 /* ttys are somewhat special (ttyxx major==4, tty major==5) */
@@ -170,7 +170,7 @@ int sys_open(const char * filename,int flag,int mode)
 			if (current->tty<0) {
 				iput(inode);
 				current->filp[fd]=NULL;
-				f->f_count=0;
+				atomic_set(&f->f_count,0);
 				return -EPERM;
 			}
 /* Likewise with block-devices: check for floppy_change */
@@ -178,9 +178,10 @@ int sys_open(const char * filename,int flag,int mode)
 		check_disk_change(inode->i_zone[0]);
 	f->f_mode = inode->i_mode;
 	f->f_flags = flag;
-	f->f_count = 1;
+	atomic_set(&f->f_count,1);
 	f->f_inode = inode;
 	f->f_pos = 0;
+	f->f_ranext = f->f_raend = f->f_rawin = 0;
 	return (fd);
 }
 
@@ -199,9 +200,9 @@ int sys_close(unsigned int fd)
 	if (!(filp = current->filp[fd]))
 		return -EINVAL;
 	current->filp[fd] = NULL;
-	if (filp->f_count == 0)
+	if (!atomic_read(&filp->f_count))
 		panic("Close: file count is 0");
-	if (--filp->f_count)
+	if (!atomic_dec_and_test(&filp->f_count))
 		return (0);
 	iput(filp->f_inode);
 	return (0);
@@ -36,7 +36,7 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
 		while (!(size=PIPE_SIZE(*inode))) {
 			wake_up(&inode->i_wait);
 			// 如果已没有写管道者，则返回已读字节数，退出
-			if (inode->i_count != 2) /* are there any writers? */
+			if (atomic_read(&inode->i_count) != 2) /* are there any writers? */
 				return read;
 			// 若有写管道者在该 i 节点上，则睡眠等待写入信息
 			sleep_on(&inode->i_wait);
@@ -71,7 +71,7 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 			// 唤醒等待该节点的进程
 			wake_up(&inode->i_wait);
 			// 若没有读管道者，向进程发送SIGPIPE信号，并返回已写入的字节数并退出(没写则返回-1)
-			if (inode->i_count != 2) { /* no readers */
+			if (atomic_read(&inode->i_count) != 2) { /* no readers */
 				current->signal |= (1<<(SIGPIPE-1));
 				return written?written:-1;
 			}
@@ -123,11 +123,11 @@ int sys_pipe(unsigned long * fildes)
 	j=0;
 	// 从file_table(这个就是file结构体数组，数组大小为NR_FILE)中取两个空闲项（引用计数字段为 0 的项），并分别设置引用计数为 1
 	for(i=0;j<2 && i<NR_FILE;i++)
-		if (!file_table[i].f_count)
-			(f[j++]=i+file_table)->f_count++;
+		if (!atomic_read(&file_table[i].f_count))
+			atomic_inc(&(f[j++]=i+file_table)->f_count);
 	// 如果只有一个空闲项，则释放该项(引用计数复位)
 	if (j==1)
-		f[0]->f_count=0;
+		atomic_set(&f[0]->f_count,0);
 	// 如果没有找到两个空闲项，则返回-1
 	if (j<2)
 		return -1;
@@ -143,7 +143,8 @@ int sys_pipe(unsigned long * fildes)
 		current->filp[fd[0]]=NULL;
 	// 如果没有找到两个空闲句柄，则释放上面获取的两个文件结构项（复位引用计数值），并返回-1
 	if (j<2) {
-		f[0]->f_count=f[1]->f_count=0;
+		atomic_set(&f[0]->f_count,0);
+		atomic_set(&f[1]->f_count,0);
 		return -1;
 	}
 	// 申请管道 i 节点，0.11中的节点数是32个，并为管道分配缓冲区（1 页内存）。
@@ -151,7 +152,8 @@ int sys_pipe(unsigned long * fildes)
 	if (!(inode=get_pipe_inode())) {
 		current->filp[fd[0]] =
 			current->filp[fd[1]] = NULL;
-		f[0]->f_count = f[1]->f_count = 0;
+		atomic_set(&f[0]->f_count,0);
+		atomic_set(&f[1]->f_count,0);
 		return -1;
 	}
 	// 初始化两个文件结构，都指向同一个 i 节点，读写指针都置零。
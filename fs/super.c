@@ -32,7 +32,7 @@ static void lock_super(struct super_block * sb)
 {
 	cli();
 	while (sb->s_lock)
-		sleep_on(&(sb->s_wait));
+		sleep_on_exclusive(&(sb->s_wait));
 	sb->s_lock = 1;
 	sti();
 }
@@ -185,7 +185,7 @@ int sys_umount(char * dev_name)
 	if (!sb->s_imount->i_mount)
 		printk("Mounted inode has i_mount=0\n");
 	for (inode=inode_table+0 ; inode<inode_table+NR_INODE ; inode++)
-		if (inode->i_dev==dev && inode->i_count)
+		if (inode->i_dev==dev && atomic_read(&inode->i_count))
 				return -EBUSY;
 	sb->s_imount->i_mount=0;
 	iput(sb->s_imount);
@@ -213,7 +213,7 @@ int sys_mount(char * dev_name, char * dir_name, int rw_flag)
 	iput(dev_i);
 	if (!(dir_i=namei(dir_name)))
 		return -ENOENT;
-	if (dir_i->i_count != 1 || dir_i->i_num == ROOT_INO) {
+	if (atomic_read(&dir_i->i_count) != 1 || dir_i->i_num == ROOT_INO) {
 		iput(dir_i);
 		return -EBUSY;
 	}
@@ -248,7 +248,7 @@ void mount_root(void)
 	if (32 != sizeof (struct d_inode))
 		panic("bad i-node size");
 	for(i=0;i<NR_FILE;i++)
-		file_table[i].f_count=0;
+		atomic_set(&file_table[i].f_count,0);
 	if (MAJOR(ROOT_DEV) == 2) {
 		printk("Insert root floppy and press ENTER");
 		wait_for_keypress();
@@ -262,7 +262,7 @@ void mount_root(void)
 		panic("Unable to mount root");
 	if (!(mi=iget(ROOT_DEV,ROOT_INO)))
 		panic("Unable to read root i-node");
-	mi->i_count += 3 ;	/* NOTE! it is logically used 4 times, not 1 */
+	atomic_add(3,&mi->i_count);	/* NOTE! it is logically used 4 times, not 1 */
 	p->s_isup = p->s_imount = mi;
 	current->pwd = mi;
 	current->root = mi;
@@ -0,0 +1,60 @@
+#ifndef _ASM_ATOMIC_H
+#define _ASM_ATOMIC_H
+
+/*
+ * Counters that may be changed on more than one cpu at the same time,
+ * like the reference counts of buffers, inodes and files. They are
+ * only ever used through these, which are single locked instructions:
+ * atomic_read() and atomic_set() don't need the lock prefix, as
+ * aligned longs are read and written in one go anyway.
+ *
+ * Only the counter is atomic: anything done depending on its value
+ * (like putting a buffer on another list) needs a lock of its own.
+ */
+typedef struct { volatile int counter; } atomic_t;
+
+#define ATOMIC_INIT(i)	{ (i) }
+
+#define atomic_read(v)		((v)->counter)
+#define atomic_set(v,i)		(((v)->counter) = (i))
+
+extern inline void atomic_add(int i, atomic_t * v)
+{
+	__asm__ __volatile__("lock ; addl %1,%0"
+		:"=m" (v->counter)
+		:"ir" (i),"m" (v->counter));
+}
+
+extern inline void atomic_sub(int i, atomic_t * v)
+{
+	__asm__ __volatile__("lock ; subl %1,%0"
+		:"=m" (v->counter)
+		:"ir" (i),"m" (v->counter));
+}
+
+extern inline void atomic_inc(atomic_t * v)
+{
+	__asm__ __volatile__("lock ; incl %0"
+		:"=m" (v->counter)
+		:"m" (v->counter));
+}
+
+extern inline void atomic_dec(atomic_t * v)
+{
+	__asm__ __volatile__("lock ; decl %0"
+		:"=m" (v->counter)
+		:"m" (v->counter));
+}
+
+/* decrement, and tell if the counter got to 0 */
+extern inline int atomic_dec_and_test(atomic_t * v)
+{
+	unsigned char c;
+
+	__asm__ __volatile__("lock ; decl %0 ; sete %1"
+		:"=m" (v->counter),"=q" (c)
+		:"m" (v->counter));
+	return c != 0;
+}
+
+#endif
@@ -18,6 +18,77 @@
 /*#define KBD_FR */
 #define KBD_FINNISH
 
+/*
+ * The request scheduler used for each kind of block device:
+ * "elevator" (the original one, reads before writes), "clook"
+ * or "deadline". See kernel/blk_drv/elevator.c
+ */
+#define RD_ELEVATOR	"elevator"
+#define FLOPPY_ELEVATOR	"elevator"
+#define HD_ELEVATOR	"deadline"
+
+/*
+ * How many entries of the request table each kind of block device
+ * gets (see kernel/blk_drv/ll_rw_blk.c). The hard disk has as many as
+ * the whole table used to: the ramdisk finishes each request at once,
+ * and the floppy is too slow for a long queue to gain much. A third of
+ * each share is kept for reads.
+ */
+#define RD_REQUESTS	4
+#define FLOPPY_REQUESTS	8
+#define HD_REQUESTS	32
+
+/*
+ * HZ is the number of timer ticks per second, and so the resolution of
+ * all kernel timing. Anything from 20 to 1000 works; times() reports
+ * in these ticks too.
+ *
+ * With TICKLESS defined, an idle cpu stops its periodic tick when it
+ * has nothing to run. Cpu 0, which keeps the time, programs the PIT to
+ * go off only when the next kernel timer is due (it can wait at most
+ * 55ms at a time); the others stop their local APIC timer until they
+ * are sent work. Timers still count in ticks, but a larger HZ costs
+ * little when idle.
+ */
+#define HZ		100
+#define TICKLESS
+
+/*
+ * The number of processes (task 0 included) that can exist at the same
+ * time. It can't be more than NR_TASKS (see linux/sched.h). Each takes
+ * a page for its task struct and one for its page directory, besides
+ * its page tables and memory.
+ */
+#define MAX_TASKS	126
+
+/*
+ * The most cpus that are started, if the bios MP table lists them.
+ * The kernel still runs on one cpu at a time (see kernel/smp.c), but
+ * processes run on all of them.
+ */
+#define NR_CPUS		4
+
+/*
+ * Define CSWITCH_BENCH to have init time CSWITCH_BENCH round trips of
+ * a byte between two processes through a pair of pipes at boot, and
+ * print how many task switches a second that makes.
+ */
+/*#define CSWITCH_BENCH	10000 */
+
+/*
+ * Define FORK_BENCH to have init time FORK_BENCH forks of a child that
+ * exits at once, and as many of one that execs "/bin/sh -c exit" at
+ * boot, and print what each of them takes.
+ */
+/*#define FORK_BENCH	1000 */
+
+/*
+ * Define HD_DMA to have the hard disk driver use bus-master DMA when
+ * it finds a PCI IDE controller (like the PIIX ones) and the drive
+ * supports it. Otherwise, or if DMA fails, it uses programmed I/O.
+ */
+#define HD_DMA
+
 /*
  * Normally, Linux can get the drive parameters from the BIOS at
  * startup, but if this for some unfathomable reason fails, you'd
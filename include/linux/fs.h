@@ -7,6 +7,8 @@
 #define _FS_H
 
 #include <sys/types.h>
+#include <linux/spinlock.h>
+#include <asm/atomic.h>
 
 /* devices are as follows: (same as minix, so we can use the minix
  * file system. These are major numbers.)
@@ -44,7 +46,7 @@ void buffer_init(long buffer_end);
 #define NR_INODE 32
 #define NR_FILE 64				// NR_FILE 是系统在某一给定时刻，限制的文件总数
 #define NR_SUPER 8
-#define NR_HASH 307
+#define NR_HASH nr_hash
 #define NR_BUFFERS nr_buffers
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
@@ -77,13 +79,16 @@ struct buffer_head {
 	unsigned short b_dev;		/* device (0 = free) */
 	unsigned char b_uptodate;
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
-	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
-	struct task_struct * b_wait;
+	unsigned char b_list;		/* lru list the buffer is on */
+	unsigned long b_flushtime;	/* jiffies when a dirty buffer is due */
+	atomic_t b_count;		/* users using this block */
+	struct wait_queue * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
 	struct buffer_head * b_prev_free;
 	struct buffer_head * b_next_free;
+	struct buffer_head * b_reqnext;	/* next buffer of a merged request */
 };
 
 struct d_inode {
@@ -105,12 +110,12 @@ struct m_inode {
 	unsigned char i_nlinks;
 	unsigned short i_zone[9];
 /* these are in memory also */
-	struct task_struct * i_wait;
+	struct wait_queue * i_wait;
 	unsigned long i_atime;
 	unsigned long i_ctime;
 	unsigned short i_dev;
 	unsigned short i_num;
-	unsigned short i_count;
+	atomic_t i_count;
 	unsigned char i_lock;
 	unsigned char i_dirt;
 	unsigned char i_pipe;
@@ -122,9 +127,13 @@ struct m_inode {
 struct file {
 	unsigned short f_mode;
 	unsigned short f_flags;
-	unsigned short f_count;
+	atomic_t f_count;
 	struct m_inode * f_inode;
 	off_t f_pos;
+/* read-ahead state, see file_dev.c */
+	unsigned long f_ranext;
+	unsigned long f_raend;
+	unsigned short f_rawin;
 };
 
 struct super_block {
@@ -143,7 +152,7 @@ struct super_block {
 	struct m_inode * s_isup;
 	struct m_inode * s_imount;
 	unsigned long s_time;
-	struct task_struct * s_wait;
+	struct wait_queue * s_wait;
 	unsigned char s_lock;
 	unsigned char s_rd_only;
 	unsigned char s_dirt;
@@ -169,7 +178,11 @@ extern struct m_inode inode_table[NR_INODE];
 extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
+/* taken to change b_lock, and to wait for it to be cleared */
+extern spinlock_t buffer_lock;
+extern struct wait_queue * buffer_wait;
 extern int nr_buffers;
+extern int nr_hash;
 
 extern void check_disk_change(int dev);
 extern int floppy_change(unsigned int nr);
@@ -193,8 +206,9 @@ extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
 extern void brelse(struct buffer_head * buf);
 extern struct buffer_head * bread(int dev,int block);
-extern void bread_page(unsigned long addr,int dev,int b[4]);
+extern int bread_page(unsigned long addr,int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
+extern void reada_block(int dev,int block);
 extern int new_block(int dev);
 extern void free_block(int dev, int block);
 extern struct m_inode * new_inode(int dev);
@@ -40,6 +40,29 @@
 #define WIN_SEEK 		0x70
 #define WIN_DIAGNOSE		0x90
 #define WIN_SPECIFY		0x91
+#define WIN_MULTREAD		0xC4	/* read sectors using multiple mode */
+#define WIN_MULTWRITE		0xC5	/* write sectors using multiple mode */
+#define WIN_SETMULT		0xC6	/* enable/disable multiple mode */
+#define WIN_READDMA		0xC8	/* read sectors using DMA */
+#define WIN_WRITEDMA		0xCA	/* write sectors using DMA */
+#define WIN_IDENTIFY		0xEC	/* ask drive to identify itself */
+
+/* Bits of HD_CMD */
+#define NIEN_CTL	0x02	/* disable drive interrupts */
+
+/* PCI IDE bus-master registers, offsets from the base in BAR4 */
+#define BM_COMMAND	0
+#define BM_STATUS	2
+#define BM_PRD		4
+
+/* Bits of BM_COMMAND */
+#define BM_START	0x01
+#define BM_READ		0x08	/* transfer to memory */
+
+/* Bits of BM_STATUS */
+#define BM_ACTIVE	0x01
+#define BM_ERR		0x02
+#define BM_INTR		0x04
 
 /* Bits for HD_ERROR */
 #define MARK_ERR	0x01	/* Bad address mark ? */
@@ -3,8 +3,38 @@
 
 #define PAGE_SIZE 4096
 
+/* these are not to be changed without changing head.s etc */
+#define LOW_MEM 0x100000
+#define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
+
+/* page table entry bits */
+#define PAGE_DIRTY	0x40
+#define PAGE_ACCESSED	0x20
+#define PAGE_USER	0x04
+#define PAGE_RW		0x02
+#define PAGE_PRESENT	0x01
+
+// 重新装入CR3，刷新“页变换高速缓存”
+#define invalidate() \
+__asm__("movl %%cr3,%%eax ; movl %%eax,%%cr3":::"ax")
+
+extern unsigned char * mem_map;
+extern long HIGH_MEMORY;
+
 extern unsigned long get_free_page(void);
+extern unsigned long get_free_pages(int order);
+extern unsigned long __get_free_pages(int order);	/* not cleared */
+#define __get_free_page() __get_free_pages(0)
+extern int refill_zero_pool(void);
 extern unsigned long put_page(unsigned long page,unsigned long address);
+extern unsigned long put_dirty_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern void free_pages(unsigned long addr, int order);
+
+/* mm/swap.c */
+extern int swap_out(void);
+extern void swap_in(unsigned long * table_ptr);
+extern void swap_free(int nr);
+extern int read_swap_page(int nr, char * buffer);
 
 #endif
@@ -1,16 +1,42 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 
-#define NR_TASKS 64                   // 系统的最多任务进程数
-#define HZ 100                        // 系统时钟滴答频率(100HZ，即每个滴答为10ms)
+/*
+ * NR_TASKS is the size of task[], and the hard limit on the number of
+ * processes: each one has its own LDT descriptor (and a TSS one, that
+ * only the idle tasks use) in the gdt, which has room for 126. How
+ * many can really exist is max_tasks (MAX_TASKS in linux/config.h).
+ *
+ * Every process has a page directory of its own (tss.cr3), with its
+ * code and data at TASK_BASE, TASK_SIZE long. The rest of the linear
+ * space is the kernel's, and the same in all directories: below
+ * TASK_BASE the memory boot/head.s maps (where task 0 lives, on
+ * pg_dir), above the end of the task the local APIC.
+ */
+#define NR_TASKS 126                  // 系统的最多任务进程数
+#define TASK_BASE 0x4000000
+#define TASK_SIZE 0xc0000000
+#include <linux/config.h>         // 系统时钟滴答频率 HZ 在这里定义
+
+#if (HZ < 20 || HZ > 1000)
+#error "HZ must be between 20 and 1000"
+#endif
+
+#if (NR_CPUS < 1 || NR_CPUS > NR_TASKS)
+#error "NR_CPUS must be between 1 and NR_TASKS"
+#endif
 
 #define FIRST_TASK task[0]
 #define LAST_TASK task[NR_TASKS-1]
 
 #include <linux/head.h>
+#include <linux/wait.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
 #include <signal.h>
+#include <sys/schedstat.h>
 
 #if (NR_OPEN > 32)
 #error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
@@ -27,8 +53,13 @@
 #define NULL ((void *) 0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
-extern int free_page_tables(unsigned long from, unsigned long size);
+struct prio_array;
+
+extern int copy_page_tables(unsigned long * from_dir, unsigned long from,
+	unsigned long * to_dir, unsigned long to, long size);
+extern int free_page_tables(unsigned long * dir, unsigned long from,
+	unsigned long size);
+extern unsigned long new_page_dir(void);
 
 extern void sched_init(void);                             // 调度程序初始化的函数
 extern void schedule(void);								  // 进程调度函数
@@ -49,6 +80,32 @@ struct i387_struct {
 	long	st_space[20];	/* 8*10 bytes for each FP-reg = 80 bytes */
 };
 
+/*
+ * The save area of fxsave/fxrstor, used instead of fnsave/frstor when
+ * the cpu has them (see fpu_init()). It must be 16-byte aligned.
+ */
+struct i387_fxsave_struct {
+	unsigned short	cwd;
+	unsigned short	swd;
+	unsigned short	twd;
+	unsigned short	fop;
+	long	fip;
+	long	fcs;
+	long	foo;
+	long	fos;
+	long	mxcsr;
+	long	mxcsr_mask;
+	long	st_space[32];	/* 8*16 bytes for each FP-reg = 128 bytes */
+	long	xmm_space[32];	/* 8*16 bytes for each XMM-reg = 128 bytes */
+	long	padding[56];
+} __attribute__ ((aligned (16)));
+
+/* the math state of a task, in a page of its own (see sched.c) */
+union i387_union {
+	struct i387_struct fsave;
+	struct i387_fxsave_struct fxsave;
+};
+
 struct tss_struct {
 	long	back_link;	/* 16 high bits zero */
 	long	esp0;
@@ -73,7 +130,6 @@ struct tss_struct {
 	long	gs;		/* 16 high bits zero */
 	long	ldt;		/* 16 high bits zero */
 	long	trace_bitmap;	/* bits: trace 0, bitmap 16-31 */
-	struct i387_struct i387;
 };
 
 // 这里是任务（进程）数据结构，或称为进程描述符。
@@ -151,6 +207,28 @@ struct task_struct {
 	struct desc_struct ldt[3];
 /* tss for this task */
 	struct tss_struct tss;
+/* kernel stack pointer while it isn't running, see switch_to() */
+	long kesp;
+/* the cpu whose run queue it's on, and its depth in the kernel lock */
+	int cpu, lock_depth;
+/* scheduler info, see sched.c */
+	int nr;			/* index in task[] */
+	int rq_prio;		/* queue it is on in rq_array */
+	struct prio_array * rq_array;	/* NULL if not on the run queue */
+	struct task_struct * next_run, * prev_run;
+	long epoch;		/* counter is up to date for this epoch */
+	struct timer_list real_timer;	/* for the alarm */
+/* all tasks, the process tree, and the pid hash */
+	struct task_struct * next_task, * prev_task;
+	struct task_struct * p_pptr, * p_cptr, * p_ysptr, * p_osptr;
+	struct task_struct * pidhash_next;
+/* scheduler statistics: when it was queued, and when it last got the cpu */
+	long sched_ready, sched_start;
+	int sched_woken;		/* queued by a wake-up */
+	struct schedstat sched_stat;
+/* math: slices in a row it used the fpu, and if it did in this one */
+	unsigned char fpu_counter, fpu_used;
+	union i387_union * i387;	/* NULL until it first uses the fpu */
 };
 
 /*
@@ -175,31 +253,94 @@ struct task_struct {
 /*tss*/	{0,PAGE_SIZE+(long)&init_task,0x10,0,0,0,0,(long)&pg_dir,\
 	 0,0,0,0,0,0,0,0, \
 	 0,0,0x17,0x17,0x17,0x17,0x17,0x17, \
-	 _LDT(0),0x80000000, \
-		{} \
+	 _LDT(0),0x80000000 \
 	}, \
 }
 
 extern struct task_struct *task[NR_TASKS];             // 任务数组
-extern struct task_struct *last_task_used_math;        // 上一个使用过协处理器的进程
-extern struct task_struct *current;                    // 当前进程
+extern int max_tasks;
+/*
+ * Each cpu has its own current task, idle task and owner of its fpu,
+ * found with smp_processor_id().
+ */
+extern struct task_struct *current_set[NR_CPUS];
+extern struct task_struct *idle_set[NR_CPUS];
+extern struct task_struct *math_owner[NR_CPUS];
+#define current (current_set[smp_processor_id()])              // 当前进程
+#define last_task_used_math (math_owner[smp_processor_id()])  // 上一个使用过协处理器的进程
+extern int running_elsewhere(struct task_struct * p);
+
+/*
+ * The idle tasks have nr 0: task 0, the one of the boot cpu, and
+ * those of the others, which aren't in task[] (see kernel/smp.c).
+ */
+#define is_idle(p) (!(p)->nr)
 extern long volatile jiffies;                          // 从开机开始算起的滴答数（10ms/滴答）
 extern long startup_time;							   // 开机时间。从 1970:0:0:0 开始计时的秒数
 
 #define CURRENT_TIME (startup_time+jiffies/HZ)		   // 当前时间（秒数）
 
-// 添加定时器函数（定时时间 jiffies 滴答数，定时到时调用函数*fn()）
-extern void add_timer(long jiffies, void (*fn)(void));
 // 不可中断的等待睡眠
-extern void sleep_on(struct task_struct ** p);
+extern void save_fpu(struct task_struct * p);
+extern void __switch_to(struct task_struct * next);
+extern void cpu_idle(void);
+extern unsigned long cpu_features(void);
+extern void sleep_on(struct wait_queue ** p);
+// 不可中断的等待睡眠，只唤醒一个这样的等待者
+extern void sleep_on_exclusive(struct wait_queue ** p);
+/* the same, letting go of a spin lock held by the caller while asleep */
+extern void sleep_on_locked(struct wait_queue ** p, spinlock_t * lock);
+extern void sleep_on_exclusive_locked(struct wait_queue ** p,
+	spinlock_t * lock);
 // 可中断的等待睡眠
-extern void interruptible_sleep_on(struct task_struct ** p);
+extern void interruptible_sleep_on(struct wait_queue ** p);
 // 明确唤醒睡眠的进程
-extern void wake_up(struct task_struct ** p);
+extern void wake_up(struct wait_queue ** p);
+extern void wake_up_process(struct task_struct * p);
+extern void signal_wake_up(struct task_struct * p);
+extern void set_alarm(struct task_struct * p, long when);
+extern struct task_struct * find_task_by_pid(long pid);
+extern void hash_pid(struct task_struct * p);
+extern void unhash_pid(struct task_struct * p);
+extern int get_task_slot(void);
+extern void put_task_slot(int nr);
+
+/*
+ * All tasks but task 0 are on a list starting at task 0, so loops over
+ * them needn't look at the empty slots of task[]. p_pptr is the parent,
+ * p_cptr the youngest child, and p_ysptr/p_osptr the next younger and
+ * older sibling. Change them with interrupts disabled: tty_intr() looks
+ * at the list.
+ */
+#define for_each_task(p) \
+	for (p = task[0] ; (p = p->next_task) != task[0] ; )
+
+#define SET_LINKS(p) do { \
+	(p)->next_task = task[0]; \
+	(p)->prev_task = task[0]->prev_task; \
+	task[0]->prev_task->next_task = (p); \
+	task[0]->prev_task = (p); \
+	(p)->p_ysptr = NULL; \
+	if ((p)->p_osptr = (p)->p_pptr->p_cptr) \
+		(p)->p_osptr->p_ysptr = (p); \
+	(p)->p_pptr->p_cptr = (p); \
+} while (0)
+
+#define REMOVE_LINKS(p) do { \
+	(p)->next_task->prev_task = (p)->prev_task; \
+	(p)->prev_task->next_task = (p)->next_task; \
+	if ((p)->p_osptr) \
+		(p)->p_osptr->p_ysptr = (p)->p_ysptr; \
+	if ((p)->p_ysptr) \
+		(p)->p_ysptr->p_osptr = (p)->p_osptr; \
+	else \
+		(p)->p_pptr->p_cptr = (p)->p_osptr; \
+} while (0)
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
- * 4-TSS0, 5-LDT0, 6-TSS1 etc ...
+ * 4-TSS0, 5-LDT0, 6-TSS1 etc ... TSS n is the tss of cpu n (that of its
+ * idle task), which only gives the kernel stack on a ring transition.
  */
 #define FIRST_TSS_ENTRY 4		// 全局表中第 1 个任务状态段(TSS)描述符的选择符索引号，前面3个分别是NULL，内核代码段描述符，内核数据段描述符
 #define FIRST_LDT_ENTRY (FIRST_TSS_ENTRY+1)						// 对应的ldt位于tss后面
@@ -208,51 +349,63 @@ extern void wake_up(struct task_struct ** p);
 #define _LDT(n) ((((unsigned long) n)<<4)+(FIRST_LDT_ENTRY<<3)) // 计算在全局表中第 n 个任务的 LDT 描述符的索引号（选择符）
 #define ltr(n) __asm__("ltr %%ax"::"a" (_TSS(n)))               // 加载第 n 个任务的任务寄存器 tr
 #define lldt(n) __asm__("lldt %%ax"::"a" (_LDT(n)))				// 加载第 n 个任务的局部描述符表寄存器 ldtr
-// 取当前运行任务的任务号（是任务数组中的索引值，与进程号 pid 不同）。
-// 返回：n - 当前任务号。用于( kernel/traps.c, 79)
+/*
+ * Cpu n has TSS n loaded: so 'str' tells which cpu we are. It is
+ * volatile as the answer changes when a task moves to another cpu.
+ */
 #define str(n) \
-__asm__("str %%ax\n\t" \
+__asm__ __volatile__("str %%ax\n\t" \
 	"subl %2,%%eax\n\t" \
 	"shrl $4,%%eax" \
 	:"=a" (n) \
-	:"a" (0),"i" (FIRST_TSS_ENTRY<<3))
+	:"0" (0),"i" (FIRST_TSS_ENTRY<<3))
+#define smp_processor_id() ({ int __cpu; str(__cpu); __cpu; })
 /*
- *	switch_to(n) should switch tasks to task nr n, first
- * checking that n isn't the current task, in which case it does nothing.
- * This also clears the TS-flag if the task we switched to has used
- * tha math co-processor latest.
+ *	switch_to(next) should switch tasks to task next, first
+ * checking that it isn't the current task, in which case it does
+ * nothing.
+ *
+ * The switch is done in software, not with a jump to the TSS of the
+ * new task: the callee-saved registers, %fs and %gs and the return
+ * address are pushed on the kernel stack, and the stack pointer saved
+ * in current->kesp. We then load the stack of next, and __switch_to()
+ * does the rest (esp0 in the tss of the cpu, ldt, cr3, TS-flag) before
+ * the 'ret' takes us to where next left off - or, for a new task, to
+ * ret_from_fork (see copy_process()). A task switch through the tss
+ * saves and loads all of it, and is a lot slower.
  */
-/*
- * switch_to(n)将切换当前任务到任务 nr，即 n。首先检测任务 n 不是当前任务，
- * 如果是则什么也不做退出。如果我们切换到的任务最近（上次运行）使用过数学
- * 协处理器的话，则还需复位控制寄存器 cr0 中的 TS 标志。
- */
-// 跳转到一个任务的 TSS 段选择符组成的地址处会造成 CPU 进行任务切换操作。
-// 输入：%0 - 偏移地址(*&__tmp.a)； %1 - 存放新 TSS 的选择符；
-// dx - 新任务 n 的 TSS 段选择符；ecx - 新任务指针 task[n]。
-// 其中临时数据结构__tmp 用于组建 177 行远跳转（far jump）指令的操作数。该操作数由 4 字节偏移
-// 地址和 2 字节的段选择符组成。因此__tmp 中 a 的值是 32 位偏移值，而 b 的低 2 字节是新 TSS 段的
-// 选择符（高 2 字节不用）。跳转到 TSS 段选择符会造成任务切换到该 TSS 对应的进程。对于造成任务
-// 切换的长跳转，a 值无用。177 行上的内存间接跳转指令使用 6 字节操作数作为跳转目的地的长指针，
-// 其格式为：jmp 16 位段选择符：32 位偏移值。但在内存中操作数的表示顺序与这里正好相反。
-// 在判断新任务上次执行是否使用过协处理器时，是通过将新任务状态段地址与保存在
-// last_task_used_math 变量中的使用过协处理器的任务状态段地址进行比较而作出的，
-// 参见 kernel/sched.c 中函数 math_state_restore()。
-#define switch_to(n) {\
-struct {long a,b;} __tmp; \
-__asm__("cmpl %%ecx,_current\n\t" \
+#define switch_to(next) {\
+long __d0,__d1,__d2; \
+__asm__ __volatile__("cmpl %%eax,%%edx\n\t" \
 	"je 1f\n\t" \
-	"movw %%dx,%1\n\t" \
-	"xchgl %%ecx,_current\n\t" \
-	"ljmp %0\n\t" \
-	"cmpl %%ecx,_last_task_used_math\n\t" \
-	"jne 1f\n\t" \
-	"clts\n" \
+	"push %%fs\n\t" \
+	"push %%gs\n\t" \
+	"pushl %%ebp\n\t" \
+	"pushl %%edi\n\t" \
+	"pushl %%esi\n\t" \
+	"pushl %%ebx\n\t" \
+	"pushl $2f\n\t" \
+	"movl %%esp,(%%eax)\n\t" \
+	"movl (%%edx),%%esp\n\t" \
+	"pushl %%ecx\n\t" \
+	"call ___switch_to\n\t" \
+	"addl $4,%%esp\n\t" \
+	"ret\n" \
+	"2:\tpopl %%ebx\n\t" \
+	"popl %%esi\n\t" \
+	"popl %%edi\n\t" \
+	"popl %%ebp\n\t" \
+	"pop %%gs\n\t" \
+	"pop %%fs\n" \
 	"1:" \
-	::"m" (*&__tmp.a),"m" (*&__tmp.b), \
-	"d" (_TSS(n)),"c" ((long) task[n])); \
+	:"=a" (__d0),"=c" (__d1),"=d" (__d2) \
+	:"0" (&current->kesp),"1" ((long) (next)),"2" (&(next)->kesp) \
+	:"memory"); \
 }
 
+// the page directory of task p
+#define page_dir(p) ((unsigned long *) (p)->tss.cr3)
+
 // 页面地址对准
 #define PAGE_ALIGN(n) (((n)+0xfff)&0xfffff000)
 
@@ -0,0 +1,42 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+/*
+ * The local APIC of each cpu is mapped (uncached) at the address it has
+ * after a reset, whatever its physical address: see smp_init(). That
+ * is above TASK_BASE+TASK_SIZE, in the part of the linear space that
+ * all page directories share (see linux/sched.h).
+ */
+#define APIC_BASE	0xfee00000
+
+#define APIC_ID		0x20
+#define APIC_TPR	0x80
+#define APIC_EOI	0xb0	/* also used in kernel/system_call.s */
+#define APIC_SVR	0xf0
+#define APIC_ICR	0x300
+#define APIC_ICR2	0x310
+#define APIC_LVTT	0x320
+#define APIC_TMICT	0x380
+#define APIC_TMCCT	0x390
+#define APIC_TDCR	0x3e0
+
+#define apic_read(reg) (*(volatile unsigned long *) (APIC_BASE+(reg)))
+#define apic_write(reg,val) \
+	(*(volatile unsigned long *) (APIC_BASE+(reg)) = (val))
+
+#define LOCAL_TIMER_VECTOR	0x40
+#define RESCHEDULE_VECTOR	0x41
+#define SPURIOUS_VECTOR		0xff
+
+extern int smp_num_cpus;
+extern int kernel_depth;
+
+extern void lock_kernel(void);
+extern void unlock_kernel(void);
+extern int release_kernel_lock(void);
+extern void reacquire_kernel_lock(int depth);
+extern void smp_send_reschedule(int cpu);
+extern void stop_local_tick(int cpu);
+extern void restart_local_tick(int cpu);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _LINUX_SPINLOCK_H
+#define _LINUX_SPINLOCK_H
+
+#include <sys/lockstat.h>
+
+/*
+ * Spin locks, for the data of the block, buffer and inode layers that
+ * cli()/sti() used to protect: cli() keeps interrupts off this cpu
+ * only. Data that interrupts touch needs the _irqsave variants, so
+ * that the interrupt can't come in on this cpu while we hold the lock
+ * (it would spin for ever). A spin lock is never held while sleeping:
+ * sleep_on_locked() lets go of it while asleep.
+ *
+ * As long as the whole kernel runs under the kernel lock (see
+ * kernel/smp.c) these never really spin. Each lock keeps counters on
+ * how it is used, see kernel/spinlock.c and sys/lockstat.h.
+ */
+typedef struct {
+	volatile int lock;
+	unsigned long start;		/* time stamp when taken */
+	struct lockstat stat;
+} spinlock_t;
+
+#define SPIN_LOCK_UNLOCKED(name) { 0, 0, { name, } }
+
+extern void spin_lock(spinlock_t * lock);
+extern void spin_unlock(spinlock_t * lock);
+
+#define spin_lock_irqsave(lock,flags) \
+{ save_flags(flags); cli(); spin_lock(lock); }
+#define spin_unlock_irqrestore(lock,flags) \
+{ spin_unlock(lock); restore_flags(flags); }
+
+#endif
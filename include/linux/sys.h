@@ -70,6 +70,14 @@ extern int sys_sgetmask();
 extern int sys_ssetmask();
 extern int sys_setreuid();
 extern int sys_setregid();
+extern int sys_bufstat();
+extern int sys_bdflush();
+extern int sys_iosched();
+extern int sys_blkstat();
+extern int sys_schedstat();
+extern int sys_lockstat();
+extern int sys_memstat();
+extern int sys_swapon();
 
 fn_ptr sys_call_table[] = { sys_setup, sys_exit, sys_fork, sys_read,
 sys_write, sys_open, sys_close, sys_waitpid, sys_creat, sys_link,
@@ -83,4 +91,5 @@ sys_getgid, sys_signal, sys_geteuid, sys_getegid, sys_acct, sys_phys,
 sys_lock, sys_ioctl, sys_fcntl, sys_mpx, sys_setpgid, sys_ulimit,
 sys_uname, sys_umask, sys_chroot, sys_ustat, sys_dup2, sys_getppid,
 sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
-sys_setreuid,sys_setregid };
+sys_setreuid,sys_setregid, sys_bufstat, sys_bdflush, sys_iosched,
+sys_blkstat, sys_schedstat, sys_lockstat, sys_memstat, sys_swapon };
@@ -0,0 +1,32 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+/*
+ * Kernel timers. The caller owns the timer_list: fill in 'expires'
+ * (in jiffies, absolute), 'function' and 'data', and add_timer() it.
+ * 'function(data)' is then called from the timer interrupt, with
+ * interrupts disabled, once jiffies has reached 'expires'.
+ *
+ * A timer can be cancelled with del_timer(), which returns 1 if it
+ * was still pending, and re-armed with mod_timer(). A timer must not
+ * be added twice. See kernel/timer.c.
+ */
+struct timer_list {
+	struct timer_list * next;
+	struct timer_list ** pprev;	/* NULL if not pending */
+	long expires;
+	void (*function)(unsigned long);
+	unsigned long data;
+};
+
+#define init_timer(t) ((t)->next = NULL, (t)->pprev = NULL)
+#define timer_pending(t) ((t)->pprev != NULL)
+
+extern void add_timer(struct timer_list * timer);
+extern int del_timer(struct timer_list * timer);
+extern void mod_timer(struct timer_list * timer, long expires);
+extern long schedule_timeout(long timeout);
+extern void run_timers(void);
+extern long next_timer_ticks(long max);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _LINUX_WAIT_H
+#define _LINUX_WAIT_H
+
+/*
+ * A wait queue is a list of these, one for each sleeping task, kept on
+ * the sleeper's kernel stack (see sleep_on() in kernel/sched.c).
+ *
+ * wake_up() wakes every waiter that isn't exclusive, but only the first
+ * exclusive one that is still asleep. Tasks sleep exclusively when they
+ * want to take what they wait for (a lock, a free buffer, a request):
+ * only one of them can have it, so waking the others just makes them go
+ * back to sleep.
+ */
+struct wait_queue {
+	struct task_struct * task;
+	int exclusive;
+	struct wait_queue * next;
+};
+
+#endif
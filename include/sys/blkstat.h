@@ -0,0 +1,26 @@
+#ifndef _SYS_BLKSTAT_H
+#define _SYS_BLKSTAT_H
+
+/*
+ * Block I/O counters of one device (major and minor), as returned by
+ * blkstat(). Times are in ticks, summed over all completed requests:
+ * bk_queue_time is the time they spent in the queue before the driver
+ * started on them, bk_service_time the time the driver took. Sectors
+ * are counted when they are submitted, so a request that fails still
+ * adds to them.
+ */
+struct blkstat {
+	long bk_reads;		/* read requests completed */
+	long bk_writes;		/* write requests completed */
+	long bk_merges;		/* buffers added to a queued request */
+	long bk_rsectors;	/* sectors submitted for reading */
+	long bk_wsectors;	/* sectors submitted for writing */
+	long bk_errors;		/* requests that ended in an I/O error */
+	long bk_in_flight;	/* requests queued or being done */
+	long bk_queue_time;
+	long bk_service_time;
+};
+
+extern int blkstat(int dev, struct blkstat * buf);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _SYS_BUFSTAT_H
+#define _SYS_BUFSTAT_H
+
+/*
+ * Buffer-cache counters as returned by bufstat(). The average number
+ * of buffers looked at per cache miss is bs_scanned/bs_misses.
+ * bs_chain[n] is the number of hash chains holding n buffers, the last
+ * entry counting all the longer ones as well.
+ */
+#define BUFSTAT_CHAINS 8
+
+struct bufstat {
+	long bs_buffers;	/* buffers in the cache */
+	long bs_clean;		/* unused, clean buffers (lru list) */
+	long bs_dirty;		/* unused, but dirty or locked */
+	long bs_used;		/* buffers somebody holds */
+	long bs_hits;		/* getblk() found the block cached */
+	long bs_misses;		/* getblk() had to recycle a buffer */
+	long bs_scanned;	/* buffers examined to find those victims */
+	long bs_max_scan;	/* worst case for a single miss */
+	long bs_nr_hash;	/* hash chains */
+	long bs_max_chain;	/* longest hash chain */
+	long bs_chain[BUFSTAT_CHAINS];
+};
+
+extern int bufstat(struct bufstat * buf);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _SYS_IOSCHED_H
+#define _SYS_IOSCHED_H
+
+/*
+ * Request scheduler of a block device major, and how long its
+ * requests took from being queued to completion, in ticks. Index 0
+ * is for reads, 1 for writes.
+ */
+struct iosched {
+	char is_name[12];
+	long is_nr[2];
+	long is_wait[2];
+	long is_max_wait[2];
+};
+
+extern int iosched(int major, struct iosched * buf);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _SYS_LOCKSTAT_H
+#define _SYS_LOCKSTAT_H
+
+/*
+ * Counters of one kernel spin lock, as returned by lockstat(). Locks
+ * are numbered from 0; the numbers aren't fixed, look at the name.
+ * ls_contended counts the times the lock was found taken, ls_spins the
+ * loops spent waiting for it. Hold times are in cpu cycles (the time
+ * stamp counter), and stay 0 on cpus without one.
+ */
+struct lockstat {
+	char ls_name[16];
+	long ls_acquired;	/* times it was taken */
+	long ls_contended;
+	long ls_spins;
+	unsigned long ls_hold_max;	/* longest time held */
+	unsigned long long ls_hold_total;
+};
+
+extern int lockstat(int n, struct lockstat * buf);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _SYS_MEMSTAT_H
+#define _SYS_MEMSTAT_H
+
+/*
+ * Page allocator counters, as returned by memstat(). Free memory is
+ * kept in blocks of 2^n pages, n < NR_MEM_LISTS (see mm/memory.c):
+ * ms_free_blocks[n] is the number of free blocks of that size right
+ * now, ms_allocs[n] the number of allocations of it so far.
+ *
+ * get_free_page() gives out pages that are cleared beforehand by the
+ * idle tasks while there are any: the zero pool. Pages in it are
+ * counted as used, not free.
+ *
+ * When memory runs low, pages of processes are swapped out (or just
+ * dropped, if clean) to the swap space given to swapon().
+ */
+#define NR_MEM_LISTS 6
+
+struct memstat {
+	long ms_total;		/* pages the allocator started with */
+	long ms_free;		/* pages free now */
+	long ms_frees;		/* pages given back */
+	long ms_failed;		/* allocations that found nothing */
+	long ms_allocs[NR_MEM_LISTS];
+	long ms_free_blocks[NR_MEM_LISTS];
+	long ms_zero_pool;	/* cleared pages ready now */
+	long ms_zero_hits;	/* get_free_page() got one of those */
+	long ms_zero_misses;	/* get_free_page() had to clear a page */
+	long ms_zero_refills;	/* pages cleared by the idle tasks */
+	long ms_swap_total;	/* pages of swap space, see swapon() */
+	long ms_swap_free;	/* of which free */
+	long ms_swap_ins;	/* pages read back in from swap */
+	long ms_swap_outs;	/* pages written out to swap */
+	long ms_swap_drops;	/* clean pages given up instead */
+};
+
+extern int memstat(struct memstat * buf);
+
+#endif
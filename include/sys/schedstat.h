@@ -0,0 +1,39 @@
+#ifndef _SYS_SCHEDSTAT_H
+#define _SYS_SCHEDSTAT_H
+
+/*
+ * Scheduler statistics as returned by schedstat(), for one process or
+ * (pid 0) the whole system. Times are in ticks (see HZ). Histogram
+ * entry 0 counts times of 0 ticks, entry n times of 2^(n-1) up to
+ * 2^n-1 ticks, and the last one all the longer times as well.
+ *
+ * ss_wait is the time from being put on the run queue (woken up, or
+ * preempted) to running again, and ss_wakeup the same for wake-ups
+ * only. ss_slice is how long the process ran before switching away.
+ *
+ * The fpu state is loaded when a process first uses the fpu after a
+ * switch (ss_fpu_traps), or right away at the switch for processes
+ * that have used it in each of their last few time slices.
+ *
+ * ss_migrations counts the times the process was taken over by the
+ * run queue of another cpu.
+ */
+#define SCHED_HIST 12
+
+struct schedstat {
+	long ss_runs;		/* times it got the cpu */
+	long ss_voluntary;	/* switched away because it went to sleep */
+	long ss_involuntary;	/* switched away while still runnable */
+	long ss_run_delay;	/* total time runnable but not running */
+	long ss_max_wakeup;	/* worst wake-up to run time */
+	long ss_fpu_traps;	/* device-not-available traps */
+	long ss_fpu_eager;	/* fpu state loaded when switching in */
+	long ss_migrations;	/* moved to another cpu */
+	long ss_wait[SCHED_HIST];
+	long ss_wakeup[SCHED_HIST];
+	long ss_slice[SCHED_HIST];
+};
+
+extern int schedstat(int pid, struct schedstat * buf);
+
+#endif
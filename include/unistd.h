@@ -54,6 +54,12 @@
 #include <sys/times.h>
 #include <sys/utsname.h>
 #include <utime.h>
+#include <sys/bufstat.h>
+#include <sys/iosched.h>
+#include <sys/blkstat.h>
+#include <sys/schedstat.h>
+#include <sys/lockstat.h>
+#include <sys/memstat.h>
 
 #ifdef __LIBRARY__
 
@@ -129,6 +135,14 @@
 #define __NR_ssetmask	69
 #define __NR_setreuid	70
 #define __NR_setregid	71
+#define __NR_bufstat	72
+#define __NR_bdflush	73
+#define __NR_iosched	74
+#define __NR_blkstat	75
+#define __NR_schedstat	76
+#define __NR_lockstat	77
+#define __NR_memstat	78
+#define __NR_swapon	79
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -249,5 +263,13 @@ int dup2(int oldfd, int newfd);
 int getppid(void);
 pid_t getpgrp(void);
 pid_t setsid(void);
+int bufstat(struct bufstat * buf);
+int bdflush(int func, long data);
+int iosched(int major, struct iosched * buf);
+int blkstat(int dev, struct blkstat * buf);
+int schedstat(int pid, struct schedstat * buf);
+int lockstat(int n, struct lockstat * buf);
+int memstat(struct memstat * buf);
+int swapon(const char * specialfile);
 
 #endif
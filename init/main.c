@@ -7,6 +7,7 @@
 #define __LIBRARY__
 #include <unistd.h>
 #include <time.h>
+#include <linux/config.h>
 
 /*
  * we need this inline - forking from kernel space will result
@@ -24,6 +25,14 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 static inline _syscall0(int,sync)
+static inline _syscall2(int,bdflush,int,func,long,data)
+#ifdef CSWITCH_BENCH
+static inline _syscall1(int,pipe,int *,fildes)
+static inline _syscall3(int,read,int,fildes,char *,buf,off_t,count)
+#endif
+#if defined(CSWITCH_BENCH) || defined(FORK_BENCH)
+static inline _syscall1(time_t,times,struct tms *,tbuf)
+#endif
 
 #include <linux/tty.h>
 #include <linux/sched.h>
@@ -49,6 +58,9 @@ extern void hd_init(void);
 extern void floppy_init(void);
 extern void mem_init(long start, long end);
 extern long rd_init(long mem_start, int length);
+extern void smp_init(void);
+extern void lockstat_init(void);
+extern void smp_boot(void);
 extern long kernel_mktime(struct tm * tm);
 extern long startup_time;
 
@@ -95,6 +107,13 @@ static void time_init(void)
 	startup_time = kernel_mktime(&time);
 }
 
+/*
+ * boot/head.s maps 64MB, which is also where the processes start in
+ * their linear space (TASK_BASE, see linux/sched.h).
+ */
+#define MAX_MEMORY TASK_BASE
+#define MAX_BUFFER_MEMORY (6*1024*1024)
+
 static long memory_end = 0;
 static long buffer_memory_end = 0;
 static long main_memory_start = 0;
@@ -103,6 +122,9 @@ struct drive_info { char dummy[32]; } drive_info;
 
 void main(void)		/* This really IS void, no error here. */
 {			/* The startup routine assumes (well, ...) this */
+#ifdef RAMDISK
+	long i;
+#endif
 /*
  * Interrupts are still disabled. Do necessary setups, then
  * enable them
@@ -111,17 +133,26 @@ void main(void)		/* This really IS void, no error here. */
  	drive_info = DRIVE_INFO;
 	memory_end = (1<<20) + (EXT_MEM_K<<10);
 	memory_end &= 0xfffff000;
-	if (memory_end > 16*1024*1024)
-		memory_end = 16*1024*1024;
-	if (memory_end > 12*1024*1024) 
-		buffer_memory_end = 4*1024*1024;
-	else if (memory_end > 6*1024*1024)
+	if (memory_end > MAX_MEMORY)
+		memory_end = MAX_MEMORY;
+/*
+ * Above 12MB the buffer cache gets a quarter of memory, as long as the
+ * buffer heads fit below 640kB: that's some 6MB worth of buffers.
+ */
+	if (memory_end > 12*1024*1024) {
+		buffer_memory_end = (memory_end/4) & 0xfffff000;
+		if (buffer_memory_end > MAX_BUFFER_MEMORY)
+			buffer_memory_end = MAX_BUFFER_MEMORY;
+	} else if (memory_end > 6*1024*1024)
 		buffer_memory_end = 2*1024*1024;
 	else
 		buffer_memory_end = 1*1024*1024;
 	main_memory_start = buffer_memory_end;
 #ifdef RAMDISK
-	main_memory_start += rd_init(main_memory_start, RAMDISK*1024);
+	i = RAMDISK*1024;
+	if (i > (memory_end-main_memory_start)/2)	/* leave some to run in */
+		i = ((memory_end-main_memory_start)/2) & 0xfffff000;
+	main_memory_start += rd_init(main_memory_start, i);
 #endif
 	mem_init(main_memory_start,memory_end);
 	trap_init();
@@ -130,10 +161,13 @@ void main(void)		/* This really IS void, no error here. */
 	tty_init();
 	time_init();
 	sched_init();
+	lockstat_init();
+	smp_init();
 	buffer_init(buffer_memory_end);
 	hd_init();
 	floppy_init();
 	sti();
+	smp_boot();
 	move_to_user_mode();
 	if (!fork()) {		/* we count on this going ok */
 		init();
@@ -159,6 +193,105 @@ static int printf(const char *fmt, ...)
 	return i;
 }
 
+#ifdef CSWITCH_BENCH
+/*
+ * Every read() of the ping-pong finds its pipe empty and sleeps, so
+ * that each round trip is two task switches.
+ */
+static void cswitch_bench(void)
+{
+	int ping[2],pong[2],pid,i;
+	struct tms tms;
+	long t;
+	char c = 0;
+
+	if (pipe(ping) || pipe(pong)) {
+		printf("cswitch: no pipes\n\r");
+		return;
+	}
+	if (!(pid=fork())) {
+		for (i=0 ; i<CSWITCH_BENCH ; i++) {
+			read(ping[0],&c,1);
+			write(pong[1],&c,1);
+		}
+		_exit(0);
+	}
+	t = times(&tms);
+	if (pid>0)
+		for (i=0 ; i<CSWITCH_BENCH ; i++) {
+			write(ping[1],&c,1);
+			read(pong[0],&c,1);
+		}
+	t = times(&tms) - t;
+	close(ping[0]); close(ping[1]);
+	close(pong[0]); close(pong[1]);
+	if (pid<0) {
+		printf("cswitch: fork failed\n\r");
+		return;
+	}
+	while (pid != wait(&i))
+		/* nothing */;
+	printf("cswitch: %d round trips in %d ticks",CSWITCH_BENCH,t);
+	if (t>0)
+		printf(", %d switches/sec",2*CSWITCH_BENCH*HZ/t);
+	printf("\n\r");
+}
+#endif
+
+#ifdef FORK_BENCH
+static char * argv_bench[] = { "sh", "-c", "exit", NULL };
+static char * envp_bench[] = { "HOME=/", NULL };
+
+/*
+ * One fork after the other, waiting for each child: with exec set the
+ * child execs a shell that exits at once, so that the time includes
+ * setting up (and tearing down) a fresh address space. Returns the
+ * ticks it took, and the number that failed in *failed.
+ */
+static long fork_loop(int exec, int * failed)
+{
+	struct tms tms;
+	long t;
+	int pid,i,status;
+
+	*failed = 0;
+	t = times(&tms);
+	for (i=0 ; i<FORK_BENCH ; i++) {
+		if (!(pid=fork())) {
+			if (exec)
+				execve("/bin/sh",argv_bench,envp_bench);
+			_exit(exec);
+		}
+		if (pid<0) {
+			(*failed)++;
+			continue;
+		}
+		while (pid != wait(&status))
+			/* nothing */;
+		if (status)
+			(*failed)++;
+	}
+	return times(&tms) - t;
+}
+
+static void fork_bench(void)
+{
+	long t;
+	int failed;
+
+	t = fork_loop(0,&failed);
+	printf("fork: %d forks in %d ticks",FORK_BENCH,t);
+	if (failed)
+		printf(" (%d failed)",failed);
+	printf(", %d us each\n\r",t*(1000000/HZ)/FORK_BENCH);
+	t = fork_loop(1,&failed);
+	printf("fork: %d fork+execs in %d ticks",FORK_BENCH,t);
+	if (failed)
+		printf(" (%d failed)",failed);
+	printf(", %d us each\n\r",t*(1000000/HZ)/FORK_BENCH);
+}
+#endif
+
 static char * argv_rc[] = { "/bin/sh", NULL };
 static char * envp_rc[] = { "HOME=/", NULL };
 
@@ -170,12 +303,20 @@ void init(void)
 	int pid,i;
 
 	setup((void *) &drive_info);
+	if (!fork())		/* the buffer flusher, see fs/buffer.c */
+		_exit(bdflush(0,0));
 	(void) open("/dev/tty0",O_RDWR,0);
 	(void) dup(0);
 	(void) dup(0);
 	printf("%d buffers = %d bytes buffer space\n\r",NR_BUFFERS,
 		NR_BUFFERS*BLOCK_SIZE);
 	printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
+#ifdef CSWITCH_BENCH
+	cswitch_bench();
+#endif
+#ifdef FORK_BENCH
+	fork_bench();
+#endif
 	if (!(pid=fork())) {
 		close(0);
 		if (open("/etc/rc",O_RDONLY,0))
@@ -36,7 +36,10 @@ no_error_code:
 	mov %dx,%ds
 	mov %dx,%es
 	mov %dx,%fs
-	call *%eax
+	movl %eax,%ebx
+	call _lock_kernel
+	call *%ebx
+	call _unlock_kernel
 	addl $8,%esp
 	pop %fs
 	pop %es
@@ -114,7 +117,9 @@ error_code:
 	mov %ax,%ds
 	mov %ax,%es
 	mov %ax,%fs
+	call _lock_kernel
 	call *%ebx
+	call _unlock_kernel
 	addl $8,%esp
 	pop %fs
 	pop %es
@@ -4,21 +4,28 @@
 #define NR_BLK_DEV	7
 /*
  * NR_REQUEST is the number of entries in the request-queue.
- * NOTE that writes may use only the low 2/3 of these: reads
- * take precedence.
+ * It is split up between the devices (see ll_rw_blk.c), each
+ * keeping part of its share for reads: they take precedence.
+ * The shares are set in linux/config.h.
  *
- * 32 seems to be a reasonable number: enough to get some benefit
- * from the elevator-mechanism, but not so much as to lock a lot of
- * buffers when they are in the queue. 64 seems to be too many (easily
- * long pauses in reading when heavy writing/syncing is going on)
+ * 32 seems to be a reasonable number for a disk: enough to get some
+ * benefit from the elevator-mechanism, but not so much as to lock a
+ * lot of buffers when they are in the queue. 64 seems to be too many
+ * (easily long pauses in reading when heavy writing/syncing is going
+ * on)
  */
-#define NR_REQUEST	32
+#define NR_REQUEST	(RD_REQUESTS+FLOPPY_REQUESTS+HD_REQUESTS)
 
 /*
  * Ok, this is an expanded form so that we can use the same
  * request for paging requests when that is implemented. In
  * paging, 'bh' is NULL, and 'waiting' is used to wait for
  * read/write completion.
+ *
+ * Requests for adjacent blocks are merged (see make_request()):
+ * 'bh' is then the first of a chain of buffers linked through
+ * b_reqnext, 'bhtail' the last one, and 'buffer' points into the
+ * data of the first one.
  */
 struct request {
 	int dev;		/* -1 if no request */
@@ -27,8 +34,11 @@ struct request {
 	unsigned long sector;
 	unsigned long nr_sectors;
 	char * buffer;
-	struct task_struct * waiting;
+	struct wait_queue * waiting;
 	struct buffer_head * bh;
+	struct buffer_head * bhtail;
+	long start;		/* jiffies when queued */
+	long issue;		/* jiffies when the driver got it */
 	struct request * next;
 };
 
@@ -42,14 +52,54 @@ struct request {
 ((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector)))
 
+struct blk_dev_struct;
+
+/*
+ * The request scheduler of a device, see elevator.c
+ */
+struct elevator {
+	char * name;
+	void (*insert)(struct blk_dev_struct * dev, struct request * req);
+	struct request * (*dispatch)(struct blk_dev_struct * dev);
+	int (*merge)(struct blk_dev_struct * dev, int rw,
+		struct buffer_head * bh);
+};
+
+/*
+ * max_sectors is the largest request the driver can do in one go:
+ * requests are merged up to this size. 0 means the driver only knows
+ * about single-buffer requests, and no merging is done.
+ *
+ * Requests for the device come from its own 'nr_requests' entries of
+ * request[], starting at 'pool'. Writes may use only the first
+ * 'nr_write' of them. Processes wait for a free entry on the device's
+ * own 'wait_for_read' or 'wait_for_write', so that an entry only reads
+ * can have doesn't wake a writer, and a writer isn't woken in place of
+ * a reader that could have used it.
+ *
+ * The lat_ fields count completed requests, and the total and worst
+ * time they spent from being queued to completion, for reads and
+ * writes.
+ */
 struct blk_dev_struct {
 	void (*request_fn)(void);
 	struct request * current_request;
+	unsigned long max_sectors;
+	struct elevator * elevator;
+	long lat_nr[2], lat_total[2], lat_max[2];
+	struct request * pool;
+	int nr_requests, nr_write;
+	struct wait_queue * wait_for_read, * wait_for_write;
 };
 
+extern struct elevator elv_default, elv_clook, elv_deadline;
+extern void set_elevator(int major, char * name);
+extern struct request * next_request(struct blk_dev_struct * dev);
+extern void blk_account(struct request * req, int uptodate);
+
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
 extern struct request request[NR_REQUEST];
-extern struct task_struct * wait_for_request;
+extern spinlock_t io_request_lock;
 
 #ifdef MAJOR_NR
 
@@ -100,28 +150,67 @@ static void (DEVICE_REQUEST)(void);
 
 extern inline void unlock_buffer(struct buffer_head * bh)
 {
+	unsigned long flags;
+
+	spin_lock_irqsave(&buffer_lock,flags);
 	if (!bh->b_lock)
 		printk(DEVICE_NAME ": free buffer being unlocked\n");
 	bh->b_lock=0;
 	wake_up(&bh->b_wait);
+	if (!atomic_read(&bh->b_count))
+		wake_up(&buffer_wait);	/* see getblk() */
+	spin_unlock_irqrestore(&buffer_lock,flags);
+}
+
+/*
+ * next_buffer() is called by drivers doing merged requests when the
+ * first buffer of the chain has been transferred: the buffer is given
+ * back, and 'buffer' moves on to the data of the next one. Returns 0
+ * if there is no next buffer, in which case nothing is done.
+ */
+extern inline int next_buffer(int uptodate)
+{
+	struct buffer_head * bh;
+
+	if (!(bh = CURRENT->bh) || !bh->b_reqnext)
+		return 0;
+	CURRENT->bh = bh->b_reqnext;
+	CURRENT->buffer = CURRENT->bh->b_data;
+	bh->b_reqnext = NULL;
+	bh->b_uptodate = uptodate;
+	unlock_buffer(bh);
+	return 1;
 }
 
 extern inline void end_request(int uptodate)
 {
+	struct buffer_head * bh;
+	struct request * req;
+	unsigned long flags;
+
+	spin_lock_irqsave(&io_request_lock,flags);
 	DEVICE_OFF(CURRENT->dev);
-	if (CURRENT->bh) {
-		CURRENT->bh->b_uptodate = uptodate;
-		unlock_buffer(CURRENT->bh);
-	}
 	if (!uptodate) {
 		printk(DEVICE_NAME " I/O error\n\r");
-		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+		printk("dev %04x, sector %d\n\r",CURRENT->dev,
+			CURRENT->sector);
+	}
+	while (bh = CURRENT->bh) {
+		CURRENT->bh = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		bh->b_uptodate = uptodate;
+		unlock_buffer(bh);
 	}
 	wake_up(&CURRENT->waiting);
-	wake_up(&wait_for_request);
-	CURRENT->dev = -1;
-	CURRENT = CURRENT->next;
+	blk_account(CURRENT,uptodate);
+	req = CURRENT;
+	CURRENT = next_request(blk_dev+MAJOR_NR);
+	req->dev = -1;
+/* one waiter of each kind: one request. The last ones are only for reads */
+	if (req - blk_dev[MAJOR_NR].pool < blk_dev[MAJOR_NR].nr_write)
+		wake_up(&blk_dev[MAJOR_NR].wait_for_write);
+	wake_up(&blk_dev[MAJOR_NR].wait_for_read);
+	spin_unlock_irqrestore(&io_request_lock,flags);
 }
 
 #define INIT_REQUEST \
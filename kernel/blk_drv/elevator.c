@@ -0,0 +1,211 @@
+/*
+ *  linux/kernel/blk_drv/elevator.c
+ */
+
+/*
+ * The request schedulers. Each block device has an elevator, which
+ * decides where a new request goes in the queue (insert), which
+ * request is done next once the driver has finished with the first
+ * one (dispatch), and whether a buffer can be added to a queued
+ * request (merge). The first request in the queue is always the one
+ * the driver is working on, so it is never moved.
+ *
+ *	elevator - the original one-way elevator: reads before writes,
+ *		   then by device and sector. Writes can starve.
+ *	clook	 - one-way sweep by device and sector, reads and writes
+ *		   alike, jumping back to the lowest sector at the end.
+ *	deadline - clook, but a request waiting for more than its
+ *		   deadline (short for reads, long for writes) is
+ *		   done next.
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+#include <sys/iosched.h>
+
+#include "blk.h"
+
+/*
+ * merge_request() tries to add the buffer to a queued request for the
+ * sectors just before or after it, so that the driver can transfer
+ * them with a single command. Called with interrupts disabled.
+ */
+int merge_request(struct blk_dev_struct * dev, int rw,
+	struct buffer_head * bh)
+{
+	struct request * req;
+	unsigned long sector = bh->b_blocknr<<1;
+
+	if (!dev->max_sectors || !(req = dev->current_request))
+		return 0;
+	while (req = req->next) {
+		if (req->dev != bh->b_dev || req->cmd != rw || !req->bh)
+			continue;
+		if (req->nr_sectors+2 > dev->max_sectors)
+			continue;
+		if (req->sector+req->nr_sectors == sector) {
+			req->bhtail->b_reqnext = bh;
+			req->bhtail = bh;
+			req->nr_sectors += 2;
+			return 1;
+		}
+		if (sector+2 == req->sector) {
+			bh->b_reqnext = req->bh;
+			req->bh = bh;
+			req->buffer = bh->b_data;
+			req->sector = sector;
+			req->nr_sectors += 2;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Insert the request into a queue kept in the order given by 'order',
+ * starting from the first request and wrapping around once: the new
+ * request goes in where it fits in the current sweep, or in the next
+ * one if the sweep has already passed it.
+ */
+static void sorted_insert(struct blk_dev_struct * dev, struct request * req,
+	int (*order)(struct request *, struct request *))
+{
+	struct request * tmp = dev->current_request;
+
+	for ( ; tmp->next ; tmp=tmp->next)
+		if ((order(tmp,req) || !order(tmp,tmp->next)) &&
+		    order(req,tmp->next))
+			break;
+	req->next=tmp->next;
+	tmp->next=req;
+}
+
+static int rw_order(struct request * s1, struct request * s2)
+{
+	return IN_ORDER(s1,s2);
+}
+
+static int sector_order(struct request * s1, struct request * s2)
+{
+	return s1->dev < s2->dev ||
+		(s1->dev == s2->dev && s1->sector < s2->sector);
+}
+
+static void elevator_insert(struct blk_dev_struct * dev, struct request * req)
+{
+	sorted_insert(dev,req,rw_order);
+}
+
+static void clook_insert(struct blk_dev_struct * dev, struct request * req)
+{
+	sorted_insert(dev,req,sector_order);
+}
+
+static struct request * fifo_dispatch(struct blk_dev_struct * dev)
+{
+	return dev->current_request->next;
+}
+
+/*
+ * Deadlines in ticks, indexed by READ/WRITE.
+ */
+static long deadline_expire[2] = { HZ/2, 5*HZ };
+
+#define DEADLINE(req) ((req)->start + deadline_expire[(req)->cmd])
+
+/*
+ * If some request has gone past its deadline, the one that expired
+ * first is moved to the front. Otherwise we just go on with the sweep.
+ */
+static struct request * deadline_dispatch(struct blk_dev_struct * dev)
+{
+	struct request * head, * req, * prev, * best = NULL, * bprev = NULL;
+
+	if (!(head = dev->current_request->next))
+		return NULL;
+	for (prev = NULL, req = head ; req ; prev = req, req = req->next) {
+		if (DEADLINE(req) > jiffies)
+			continue;
+		if (!best || DEADLINE(req) < DEADLINE(best)) {
+			best = req;
+			bprev = prev;
+		}
+	}
+	if (!best || best == head)
+		return head;
+	bprev->next = best->next;
+	best->next = head;
+	return best;
+}
+
+struct elevator elv_default = {
+	"elevator", elevator_insert, fifo_dispatch, merge_request };
+struct elevator elv_clook = {
+	"clook", clook_insert, fifo_dispatch, merge_request };
+struct elevator elv_deadline = {
+	"deadline", clook_insert, deadline_dispatch, merge_request };
+
+static struct elevator * elevators[] = {
+	&elv_default, &elv_clook, &elv_deadline, NULL };
+
+void set_elevator(int major, char * name)
+{
+	struct elevator ** e;
+
+	for (e = elevators ; *e ; e++)
+		if (!strcmp((*e)->name,name)) {
+			blk_dev[major].elevator = *e;
+			return;
+		}
+	printk("Unknown elevator '%s' for major %d\n\r",name,major);
+}
+
+/*
+ * next_request() is called from end_request() when the first request
+ * in the queue is done. It accounts for it, and returns the request
+ * the driver should do next.
+ */
+struct request * next_request(struct blk_dev_struct * dev)
+{
+	struct request * req = dev->current_request;
+	long wait = jiffies - req->start;
+
+	dev->lat_nr[req->cmd]++;
+	dev->lat_total[req->cmd] += wait;
+	if (wait > dev->lat_max[req->cmd])
+		dev->lat_max[req->cmd] = wait;
+	if (req = (dev->elevator->dispatch)(dev))
+		req->issue = jiffies;
+	return req;
+}
+
+int sys_iosched(int major, struct iosched * buf)
+{
+	struct blk_dev_struct * dev;
+	struct iosched tmp;
+	unsigned long flags;
+	int i;
+
+	if (major < 0 || major >= NR_BLK_DEV || !buf)
+		return -EINVAL;
+	dev = blk_dev + major;
+	if (!dev->request_fn)
+		return -ENODEV;
+	strncpy(tmp.is_name,dev->elevator->name,sizeof tmp.is_name);
+/* next_request() updates these from interrupts */
+	spin_lock_irqsave(&io_request_lock,flags);
+	for (i=0 ; i<2 ; i++) {
+		tmp.is_nr[i] = dev->lat_nr[i];
+		tmp.is_wait[i] = dev->lat_total[i];
+		tmp.is_max_wait[i] = dev->lat_max[i];
+	}
+	spin_unlock_irqrestore(&io_request_lock,flags);
+	verify_area(buf,sizeof *buf);
+	for (i=0 ; i<sizeof *buf ; i++)
+		put_fs_byte(((char *) &tmp)[i],i+(char *) buf);
+	return 0;
+}
@@ -120,7 +120,7 @@ static unsigned char seek_track = 0;
 static unsigned char current_track = 255;
 static unsigned char command = 0;
 unsigned char selected = 0;
-struct task_struct * wait_on_floppy_select = NULL;
+struct wait_queue * wait_on_floppy_select = NULL;
 
 void floppy_deselect(unsigned int nr)
 {
@@ -401,6 +401,29 @@ static void reset_floppy(void)
 	sti();
 }
 
+/*
+ * The floppy only needs one timer at a time: the one that calls fn
+ * after the given number of ticks. fn is called at once if there is
+ * no need to wait.
+ */
+static struct timer_list fd_timer = { NULL, NULL, };
+
+static void fd_timeout(unsigned long fn)
+{
+	((void (*)(void)) fn)();
+}
+
+static void fd_delay(long ticks, void (*fn)(void))
+{
+	if (ticks <= 0) {
+		fn();
+		return;
+	}
+	fd_timer.function = fd_timeout;
+	fd_timer.data = (unsigned long) fn;
+	mod_timer(&fd_timer,jiffies+ticks);
+}
+
 static void floppy_on_interrupt(void)
 {
 /* We cannot do a floppy-select, as that might sleep. We just force it */
@@ -409,7 +432,7 @@ static void floppy_on_interrupt(void)
 		current_DOR &= 0xFC;
 		current_DOR |= current_drive;
 		outb(current_DOR,FD_DOR);
-		add_timer(2,&transfer);
+		fd_delay((HZ+49)/50,&transfer);
 	} else
 		transfer();
 }
@@ -451,7 +474,7 @@ void do_fd_request(void)
 		command = FD_WRITE;
 	else
 		panic("do_fd_request: unknown command");
-	add_timer(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
+	fd_delay(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
 }
 
 void floppy_init(void)
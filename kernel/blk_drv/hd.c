@@ -33,11 +33,35 @@ inb_p(0x71); \
 /* Max read/write errors/sector */
 #define MAX_ERRORS	7
 #define MAX_HD		2
+/* Largest merged request: the sector count register is only 8 bits */
+#define HD_MAX_SECTORS	128
 
 static void recal_intr(void);
 
 static int recalibrate = 1;
 static int reset = 1;
+static int remult = 0;
+
+/*
+ * Sectors per interrupt with READ/WRITE MULTIPLE for each drive, or 0
+ * if the drive doesn't do multiple mode. mult_sect is the number used
+ * by the command in progress.
+ */
+#define MAX_MULT	16
+static int multcount[MAX_HD] = {0,};
+static unsigned int mult_sect = 1;
+
+#ifdef HD_DMA
+/*
+ * Bus-master DMA: bm_base is the I/O base of the bus-master registers
+ * of the primary channel (0 if no PCI IDE controller was found), and
+ * prd_table the physical region descriptor table, one entry per
+ * buffer. It gets a page of its own, so it never crosses 64kB.
+ */
+static int hd_dma[MAX_HD] = {0,};
+static unsigned short bm_base = 0;
+static unsigned long * prd_table = NULL;
+#endif
 
 /*
  *  This struct defines the HD's and their types.
@@ -67,6 +91,8 @@ __asm__("cld;rep;outsw"::"d" (port),"S" (buf),"c" (nr):"cx","si")
 extern void hd_interrupt(void);
 extern void rd_load(void);
 
+static void hd_identify(int drive);
+
 /* This may be used only once, enforced by 'static int callable' */
 int sys_setup(void * BIOS)
 {
@@ -133,6 +159,8 @@ int sys_setup(void * BIOS)
 		hd[i*5].start_sect = 0;
 		hd[i*5].nr_sects = 0;
 	}
+	for (drive=0 ; drive<NR_HD ; drive++)
+		hd_identify(drive);
 	for (drive=0 ; drive<NR_HD ; drive++) {
 		if (!(bh = bread(0x300 + drive*5,0))) {
 			printk("Unable to read partition table of drive %d\n\r",
@@ -166,6 +194,67 @@ static int controller_ready(void)
 	return (retries);
 }
 
+/*
+ * Polled wait for the status bits in 'mask' to read as 'val'. Returns
+ * the status, or -1 if the drive didn't get there in time.
+ */
+static int hd_poll(int mask, int val)
+{
+	int i, r;
+
+	for (i = 0; i < 100000; i++)
+		if (((r = inb_p(HD_STATUS)) & mask) == val)
+			return r;
+	return -1;
+}
+
+/*
+ * hd_identify() asks the drive (IDENTIFY) what it can do. If it can
+ * move several sectors per interrupt, multiple mode is turned on with
+ * as many as it allows, up to MAX_MULT. If it does DMA and there is a
+ * bus-master controller, DMA is used for it. It runs at setup time,
+ * polled and with the drive interrupt turned off. Old drives abort
+ * IDENTIFY: they just get one sector per interrupt.
+ */
+static void hd_identify(int drive)
+{
+	static unsigned short id[256];
+	int mult, r;
+
+	outb_p(hd_info[drive].ctl | NIEN_CTL,HD_CMD);
+	multcount[drive] = 0;
+	if (hd_poll(BUSY_STAT,0) < 0)
+		goto out;
+	outb_p(0xA0|(drive<<4),HD_CURRENT);
+	outb_p(WIN_IDENTIFY,HD_COMMAND);
+	r = hd_poll(BUSY_STAT,0);
+	if (r < 0 || (r & ERR_STAT) || !(r & DRQ_STAT))
+		goto out;
+	port_read(HD_DATA,id,256);
+#ifdef HD_DMA
+	if (bm_base && prd_table && (id[49] & 0x100)) {
+		hd_dma[drive] = 1;
+		outb(inb(bm_base+BM_STATUS) | (0x20<<drive),bm_base+BM_STATUS);
+		printk("Drive %d: bus-master DMA\n\r",drive);
+	}
+#endif
+	r = id[47] & 0xff;
+	for (mult = MAX_MULT ; mult > r ; mult >>= 1)
+		/* nothing */ ;
+	if (mult < 2)
+		goto out;
+	outb_p(mult,HD_NSECTOR);
+	outb_p(0xA0|(drive<<4),HD_CURRENT);
+	outb_p(WIN_SETMULT,HD_COMMAND);
+	r = hd_poll(BUSY_STAT,0);
+	if (r < 0 || (r & ERR_STAT))
+		goto out;
+	multcount[drive] = mult;
+	printk("Drive %d: %d sectors per interrupt\n\r",drive,mult);
+out:
+	outb_p(hd_info[drive].ctl,HD_CMD);
+}
+
 static int win_result(void)
 {
 	int i=inb_p(HD_STATUS);
@@ -230,6 +319,7 @@ static void reset_controller(void)
 static void reset_hd(int nr)
 {
 	reset_controller();
+	remult = 1;
 	hd_out(nr,hd_info[nr].sect,hd_info[nr].sect,hd_info[nr].head-1,
 		hd_info[nr].cyl,WIN_SPECIFY,&recal_intr);
 }
@@ -247,18 +337,58 @@ static void bad_rw_intr(void)
 		reset = 1;
 }
 
+/*
+ * Move the request on by nr sectors, going on to the next buffer of a
+ * merged request each time one is complete.
+ */
+static void hd_advance(unsigned int nr)
+{
+	while (nr--) {
+		CURRENT->buffer += 512;
+		CURRENT->sector++;
+		if (--CURRENT->nr_sectors && !(CURRENT->nr_sectors & 1))
+			next_buffer(1);
+	}
+}
+
+/*
+ * Send the next nr sectors of the request to the drive. The request
+ * isn't moved on until write_intr() knows they have been written.
+ */
+static void hd_write_sectors(unsigned int nr)
+{
+	struct buffer_head * bh = CURRENT->bh;
+	char * p = CURRENT->buffer;
+
+	while (nr--) {
+		port_write(HD_DATA,p,256);
+		p += 512;
+		if (bh && p == bh->b_data+BLOCK_SIZE && bh->b_reqnext) {
+			bh = bh->b_reqnext;
+			p = bh->b_data;
+		}
+	}
+}
+
+#define MULT_BLOCK() \
+(CURRENT->nr_sectors < mult_sect ? CURRENT->nr_sectors : mult_sect)
+
 static void read_intr(void)
 {
+	unsigned int nr;
+
 	if (win_result()) {
 		bad_rw_intr();
 		do_hd_request();
 		return;
 	}
-	port_read(HD_DATA,CURRENT->buffer,256);
+	nr = MULT_BLOCK();
+	while (nr--) {
+		port_read(HD_DATA,CURRENT->buffer,256);
+		hd_advance(1);
+	}
 	CURRENT->errors = 0;
-	CURRENT->buffer += 512;
-	CURRENT->sector++;
-	if (--CURRENT->nr_sectors) {
+	if (CURRENT->nr_sectors) {
 		do_hd = &read_intr;
 		return;
 	}
@@ -273,17 +403,23 @@ static void write_intr(void)
 		do_hd_request();
 		return;
 	}
-	if (--CURRENT->nr_sectors) {
-		CURRENT->sector++;
-		CURRENT->buffer += 512;
+	hd_advance(MULT_BLOCK());
+	if (CURRENT->nr_sectors) {
 		do_hd = &write_intr;
-		port_write(HD_DATA,CURRENT->buffer,256);
+		hd_write_sectors(MULT_BLOCK());
 		return;
 	}
 	end_request(1);
 	do_hd_request();
 }
 
+static void mult_intr(void)
+{
+	if (win_result())
+		multcount[CURRENT_DEV] = 0;
+	do_hd_request();
+}
+
 static void recal_intr(void)
 {
 	if (win_result())
@@ -291,6 +427,105 @@ static void recal_intr(void)
 	do_hd_request();
 }
 
+#ifdef HD_DMA
+#define PCI_CONFIG(bus,dev,fn,reg) \
+(0x80000000 | ((bus)<<16) | ((dev)<<11) | ((fn)<<8) | ((reg) & 0xfc))
+
+static unsigned long pci_read(int dev, int fn, int reg)
+{
+	outl(PCI_CONFIG(0,dev,fn,reg),0xCF8);
+	return inl(0xCFC);
+}
+
+static void pci_write(int dev, int fn, int reg, unsigned long val)
+{
+	outl(PCI_CONFIG(0,dev,fn,reg),0xCF8);
+	outl(val,0xCFC);
+}
+
+/*
+ * Look for a PCI IDE controller (class 01, subclass 01) on bus 0 with
+ * bus-master support, and turn bus mastering on. Returns the I/O base
+ * of the primary channel bus-master registers, 0 if none is found.
+ */
+static unsigned short hd_dma_probe(void)
+{
+	int dev, fn;
+	unsigned long class, bar;
+
+	for (dev = 0 ; dev < 32 ; dev++)
+		for (fn = 0 ; fn < 8 ; fn++) {
+			if ((pci_read(dev,fn,0) & 0xffff) == 0xffff)
+				continue;
+			class = pci_read(dev,fn,8);
+			if ((class >> 16) != 0x0101 || !(class & 0x8000))
+				continue;
+			bar = pci_read(dev,fn,0x20);
+			if (!(bar & 1) || !(bar & 0xfffc))
+				continue;
+			pci_write(dev,fn,4,(pci_read(dev,fn,4) & 0xffff) | 4);
+			return bar & 0xfffc;
+		}
+	return 0;
+}
+
+/*
+ * Fill in the PRD table for the current request, one entry per buffer
+ * (the first one may be partly done, after an error). Then load the
+ * table and the direction, and clear the status. Returns 0 if the
+ * request can't be done with DMA.
+ */
+static int hd_dma_setup(void)
+{
+	struct buffer_head * bh = CURRENT->bh;
+	unsigned long * prd = prd_table;
+	char * p = CURRENT->buffer;
+	unsigned long nr = CURRENT->nr_sectors, n;
+
+	if (!bh)
+		return 0;
+	while (nr) {
+		if (!bh)
+			return 0;
+		n = (bh->b_data+BLOCK_SIZE-p) >> 9;
+		if (n > nr)
+			n = nr;
+		*prd++ = (unsigned long) p;
+		*prd++ = n << 9;
+		nr -= n;
+		if (bh = bh->b_reqnext)
+			p = bh->b_data;
+	}
+	prd[-1] |= 0x80000000;
+	outl((unsigned long) prd_table,bm_base+BM_PRD);
+	outb(CURRENT->cmd == READ ? BM_READ : 0,bm_base+BM_COMMAND);
+	outb(inb(bm_base+BM_STATUS) | BM_ERR | BM_INTR,bm_base+BM_STATUS);
+	return 1;
+}
+
+/*
+ * The whole request has been transferred (or has failed) in one go.
+ * A drive that gets a DMA error goes back to programmed I/O.
+ */
+static void dma_intr(void)
+{
+	int st;
+
+	outb(0,bm_base+BM_COMMAND);
+	st = inb(bm_base+BM_STATUS);
+	outb(st | BM_ERR | BM_INTR,bm_base+BM_STATUS);
+	if (win_result() || (st & BM_ERR)) {
+		printk("Drive %d: DMA error, using PIO\n\r",CURRENT_DEV);
+		hd_dma[CURRENT_DEV] = 0;
+		bad_rw_intr();
+		do_hd_request();
+		return;
+	}
+	end_request(1);
+	do_hd_request();
+}
+#endif
+
 void do_hd_request(void)
 {
 	int i,r;
@@ -301,7 +536,7 @@ void do_hd_request(void)
 	INIT_REQUEST;
 	dev = MINOR(CURRENT->dev);
 	block = CURRENT->sector;
-	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects) {
+	if (dev >= 5*NR_HD || block+CURRENT->nr_sectors > hd[dev].nr_sects) {
 		end_request(0);
 		goto repeat;
 	}
@@ -325,17 +560,37 @@ void do_hd_request(void)
 			WIN_RESTORE,&recal_intr);
 		return;
 	}	
+/* a reset turns multiple mode off again */
+	if (remult) {
+		remult = 0;
+		if (multcount[dev]) {
+			hd_out(dev,multcount[dev],0,0,0,WIN_SETMULT,&mult_intr);
+			return;
+		}
+	}
+#ifdef HD_DMA
+	if (hd_dma[dev] && (CURRENT->cmd == READ || CURRENT->cmd == WRITE)
+	    && hd_dma_setup()) {
+		hd_out(dev,nsect,sec,head,cyl,(CURRENT->cmd == READ) ?
+			WIN_READDMA : WIN_WRITEDMA,&dma_intr);
+		outb(inb(bm_base+BM_COMMAND) | BM_START,bm_base+BM_COMMAND);
+		return;
+	}
+#endif
+	mult_sect = multcount[dev] ? multcount[dev] : 1;
 	if (CURRENT->cmd == WRITE) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_WRITE,&write_intr);
+		hd_out(dev,nsect,sec,head,cyl,
+			multcount[dev] ? WIN_MULTWRITE : WIN_WRITE,&write_intr);
 		for(i=0 ; i<3000 && !(r=inb_p(HD_STATUS)&DRQ_STAT) ; i++)
 			/* nothing */ ;
 		if (!r) {
 			bad_rw_intr();
 			goto repeat;
 		}
-		port_write(HD_DATA,CURRENT->buffer,256);
+		hd_write_sectors(MULT_BLOCK());
 	} else if (CURRENT->cmd == READ) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_READ,&read_intr);
+		hd_out(dev,nsect,sec,head,cyl,
+			multcount[dev] ? WIN_MULTREAD : WIN_READ,&read_intr);
 	} else
 		panic("unknown hd-command");
 }
@@ -343,6 +598,12 @@ void do_hd_request(void)
 void hd_init(void)
 {
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].max_sectors = HD_MAX_SECTORS;
+#ifdef HD_DMA
+	if ((bm_base = hd_dma_probe()) && !(prd_table =
+	    (unsigned long *) get_free_page()))
+		bm_base = 0;
+#endif
 	set_intr_gate(0x2E,&hd_interrupt);
 	outb_p(inb_p(0x21)&0xfb,0x21);
 	outb(inb_p(0xA1)&0xbf,0xA1);
@@ -8,9 +8,12 @@
  * This handles all read/write requests to block devices
  */
 #include <errno.h>
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
+#include <asm/segment.h>
+#include <sys/blkstat.h>
 
 #include "blk.h"
 
@@ -21,73 +24,178 @@
 struct request request[NR_REQUEST];
 
 /*
- * used to wait on when there are no free requests
+ * io_request_lock is held (with interrupts off) for anything done to
+ * the request queues and the entries of request[], the elevators and
+ * the I/O counters. end_request() takes it in the interrupt.
  */
-struct task_struct * wait_for_request = NULL;
+spinlock_t io_request_lock = SPIN_LOCK_UNLOCKED("io_request");
+
+/*
+ * How the request table is split up: the number of entries each major
+ * gets (from linux/config.h), and how many of those writes may use,
+ * two thirds as in the old shared table. The rest are for reads only.
+ * As every device has its own entries, a slow device (or a ramdisk
+ * burst) can't use up the requests of another one. The character
+ * devices get none.
+ */
+#define WRITE_SHARE(n) ((n)*2/3)
+
+static struct {
+	int nr_requests;
+	int nr_write;
+} queue_depth[NR_BLK_DEV] = {
+	{ 0, 0 },		/* no_dev */
+	{ RD_REQUESTS, WRITE_SHARE(RD_REQUESTS) },		/* dev mem */
+	{ FLOPPY_REQUESTS, WRITE_SHARE(FLOPPY_REQUESTS) },	/* dev fd */
+	{ HD_REQUESTS, WRITE_SHARE(HD_REQUESTS) },		/* dev hd */
+	{ 0, 0 },		/* dev ttyx */
+	{ 0, 0 },		/* dev tty */
+	{ 0, 0 }		/* dev lp */
+};
 
 /* blk_dev_struct is:
  *	do_request-address
  *	next-request
  */
 struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
-	{ NULL, NULL },		/* no_dev */
-	{ NULL, NULL },		/* dev mem */
-	{ NULL, NULL },		/* dev fd */
-	{ NULL, NULL },		/* dev hd */
-	{ NULL, NULL },		/* dev ttyx */
-	{ NULL, NULL },		/* dev tty */
-	{ NULL, NULL }		/* dev lp */
+	{ NULL, NULL, 0, &elv_default },		/* no_dev */
+	{ NULL, NULL, 0, &elv_default },		/* dev mem */
+	{ NULL, NULL, 0, &elv_default },		/* dev fd */
+	{ NULL, NULL, 0, &elv_default },		/* dev hd */
+	{ NULL, NULL, 0, &elv_default },		/* dev ttyx */
+	{ NULL, NULL, 0, &elv_default },		/* dev tty */
+	{ NULL, NULL, 0, &elv_default }		/* dev lp */
 };
 
+/*
+ * I/O counters, per device number. A slot is given to a device the
+ * first time it is used, and kept: NR_BLKSTAT should be enough for
+ * the disks and partitions of a normal machine. Devices that don't
+ * get a slot simply aren't counted.
+ */
+#define NR_BLKSTAT 16
+
+static struct {
+	int dev;
+	struct blkstat st;
+} blk_stats[NR_BLKSTAT];
+
+/*
+ * Called with io_request_lock held.
+ */
+static struct blkstat * find_blkstat(int dev, int create)
+{
+	int i;
+
+	for (i=0 ; i<NR_BLKSTAT ; i++)
+		if (blk_stats[i].dev == dev)
+			return &blk_stats[i].st;
+	if (!create)
+		return NULL;
+	for (i=0 ; i<NR_BLKSTAT ; i++)
+		if (!blk_stats[i].dev) {
+			blk_stats[i].dev = dev;
+			return &blk_stats[i].st;
+		}
+	return NULL;
+}
+
+/*
+ * blk_account() is called from end_request() for the request that
+ * has just been done, before the next one is started.
+ */
+void blk_account(struct request * req, int uptodate)
+{
+	struct blkstat * st;
+
+	if (!(st = find_blkstat(req->dev,0)))
+		return;
+	if (req->cmd == READ)
+		st->bk_reads++;
+	else
+		st->bk_writes++;
+	if (!uptodate)
+		st->bk_errors++;
+	st->bk_in_flight--;
+	st->bk_queue_time += req->issue - req->start;
+	st->bk_service_time += jiffies - req->issue;
+}
+
+int sys_blkstat(int dev, struct blkstat * buf)
+{
+	struct blkstat * st, tmp;
+	unsigned long flags;
+	int i;
+
+	if (!dev || !buf)
+		return -EINVAL;
+	spin_lock_irqsave(&io_request_lock,flags);
+	if (!(st = find_blkstat(dev,0))) {
+		spin_unlock_irqrestore(&io_request_lock,flags);
+		return -ENODEV;
+	}
+	tmp = *st;
+	spin_unlock_irqrestore(&io_request_lock,flags);
+	verify_area(buf,sizeof *buf);
+	for (i=0 ; i<sizeof *buf ; i++)
+		put_fs_byte(((char *) &tmp)[i],i+(char *) buf);
+	return 0;
+}
+
 static inline void lock_buffer(struct buffer_head * bh)
 {
-	cli();
+	unsigned long flags;
+
+	spin_lock_irqsave(&buffer_lock,flags);
 	while (bh->b_lock)
-		sleep_on(&bh->b_wait);
+		sleep_on_exclusive_locked(&bh->b_wait,&buffer_lock);
 	bh->b_lock=1;
-	sti();
+	spin_unlock_irqrestore(&buffer_lock,flags);
 }
 
 static inline void unlock_buffer(struct buffer_head * bh)
 {
+	unsigned long flags;
+
+	spin_lock_irqsave(&buffer_lock,flags);
 	if (!bh->b_lock)
 		printk("ll_rw_block.c: buffer not locked\n\r");
 	bh->b_lock = 0;
 	wake_up(&bh->b_wait);
+	if (!atomic_read(&bh->b_count))
+		wake_up(&buffer_wait);	/* see getblk() */
+	spin_unlock_irqrestore(&buffer_lock,flags);
 }
 
 /*
- * add-request adds a request to the linked list.
- * It disables interrupts so that it can muck with the
- * request-lists in peace.
+ * add-request adds a request to the linked list. It is called with
+ * io_request_lock held, which it lets go of, so that it can muck
+ * with the request-lists in peace. Where it goes is up to the
+ * elevator of the device.
  */
-static void add_request(struct blk_dev_struct * dev, struct request * req)
+static void add_request(struct blk_dev_struct * dev, struct request * req,
+	unsigned long flags)
 {
-	struct request * tmp;
-
 	req->next = NULL;
-	cli();
 	if (req->bh)
 		req->bh->b_dirt = 0;
-	if (!(tmp = dev->current_request)) {
+	if (!dev->current_request) {
+		req->issue = jiffies;
 		dev->current_request = req;
-		sti();
+		spin_unlock_irqrestore(&io_request_lock,flags);
 		(dev->request_fn)();
 		return;
 	}
-	for ( ; tmp->next ; tmp=tmp->next)
-		if ((IN_ORDER(tmp,req) ||
-		    !IN_ORDER(tmp,tmp->next)) &&
-		    IN_ORDER(req,tmp->next))
-			break;
-	req->next=tmp->next;
-	tmp->next=req;
-	sti();
+	(dev->elevator->insert)(dev,req);
+	spin_unlock_irqrestore(&io_request_lock,flags);
 }
 
 static void make_request(int major,int rw, struct buffer_head * bh)
 {
+	struct blk_dev_struct * dev = major+blk_dev;
 	struct request * req;
+	struct blkstat * st;
+	unsigned long flags;
 	int rw_ahead;
 
 /* WRITEA/READA is special case - it is not really needed, so if the */
@@ -107,26 +215,42 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 		unlock_buffer(bh);
 		return;
 	}
+	bh->b_reqnext = NULL;
+	spin_lock_irqsave(&io_request_lock,flags);
 repeat:
+	if ((dev->elevator->merge)(dev,rw,bh)) {
+		bh->b_dirt = 0;
+		if (st = find_blkstat(bh->b_dev,1)) {
+			st->bk_merges++;
+			if (rw == READ)
+				st->bk_rsectors += 2;
+			else
+				st->bk_wsectors += 2;
+		}
+		spin_unlock_irqrestore(&io_request_lock,flags);
+		return;
+	}
 /* we don't allow the write-requests to fill up the queue completely:
- * we want some room for reads: they take precedence. The last third
- * of the requests are only for reads.
+ * we want some room for reads: they take precedence. The last part
+ * of the device's requests are only for reads.
  */
 	if (rw == READ)
-		req = request+NR_REQUEST;
+		req = dev->pool+dev->nr_requests;
 	else
-		req = request+((NR_REQUEST*2)/3);
+		req = dev->pool+dev->nr_write;
 /* find an empty request */
-	while (--req >= request)
+	while (--req >= dev->pool)
 		if (req->dev<0)
 			break;
 /* if none found, sleep on new requests: check for rw_ahead */
-	if (req < request) {
+	if (req < dev->pool) {
 		if (rw_ahead) {
+			spin_unlock_irqrestore(&io_request_lock,flags);
 			unlock_buffer(bh);
 			return;
 		}
-		sleep_on(&wait_for_request);
+		sleep_on_exclusive_locked((rw == READ) ? &dev->wait_for_read :
+			&dev->wait_for_write,&io_request_lock);
 		goto repeat;
 	}
 /* fill up the request-info, and add it to the queue */
@@ -138,8 +262,17 @@ repeat:
 	req->buffer = bh->b_data;
 	req->waiting = NULL;
 	req->bh = bh;
+	req->bhtail = bh;
+	req->start = jiffies;
 	req->next = NULL;
-	add_request(major+blk_dev,req);
+	if (st = find_blkstat(req->dev,1)) {
+		st->bk_in_flight++;
+		if (rw == READ)
+			st->bk_rsectors += 2;
+		else
+			st->bk_wsectors += 2;
+	}
+	add_request(dev,req,flags);
 }
 
 void  ll_rw_block(int rw, struct buffer_head * bh)
@@ -156,10 +289,24 @@ void  ll_rw_block(int rw, struct buffer_head * bh)
 
 void blk_dev_init(void)
 {
+	struct request * req = request;
 	int i;
 
 	for (i=0 ; i<NR_REQUEST ; i++) {
 		request[i].dev = -1;
 		request[i].next = NULL;
 	}
+	for (i=0 ; i<NR_BLK_DEV ; i++) {
+		if (queue_depth[i].nr_write > queue_depth[i].nr_requests)
+			panic("blk_dev_init: more write requests than requests");
+		blk_dev[i].pool = req;
+		blk_dev[i].nr_requests = queue_depth[i].nr_requests;
+		blk_dev[i].nr_write = queue_depth[i].nr_write;
+		req += queue_depth[i].nr_requests;
+	}
+	if (req > request+NR_REQUEST)
+		panic("blk_dev_init: queue depths exceed NR_REQUEST");
+	set_elevator(1,RD_ELEVATOR);
+	set_elevator(2,FLOPPY_ELEVATOR);
+	set_elevator(3,HD_ELEVATOR);
 }
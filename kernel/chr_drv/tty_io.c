@@ -110,13 +110,15 @@ void tty_init(void)
 
 void tty_intr(struct tty_struct * tty, int mask)
 {
-	int i;
+	struct task_struct * p;
 
 	if (tty->pgrp <= 0)
 		return;
-	for (i=0;i<NR_TASKS;i++)
-		if (task[i] && task[i]->pgrp==tty->pgrp)
-			task[i]->signal |= mask;
+	for_each_task(p)
+		if (p->pgrp==tty->pgrp) {
+			p->signal |= mask;
+			signal_wake_up(p);
+		}
 }
 
 static void sleep_if_empty(struct tty_queue * queue)
@@ -237,12 +239,12 @@ int tty_read(unsigned channel, char * buf, int nr)
 	if (channel>2 || nr<0) return -1;
 	tty = &tty_table[channel];
 	oldalarm = current->alarm;
-	time = 10L*tty->termios.c_cc[VTIME];
+	time = (HZ/10L)*tty->termios.c_cc[VTIME];
 	minimum = tty->termios.c_cc[VMIN];
 	if (time && !minimum) {
 		minimum=1;
 		if (flag=(!oldalarm || time+jiffies<oldalarm))
-			current->alarm = time+jiffies;
+			set_alarm(current,time+jiffies);
 	}
 	if (minimum>nr)
 		minimum=nr;
@@ -272,16 +274,16 @@ int tty_read(unsigned channel, char * buf, int nr)
 		} while (nr>0 && !EMPTY(tty->secondary));
 		if (time && !L_CANON(tty))
 			if (flag=(!oldalarm || time+jiffies<oldalarm))
-				current->alarm = time+jiffies;
+				set_alarm(current,time+jiffies);
 			else
-				current->alarm = oldalarm;
+				set_alarm(current,oldalarm);
 		if (L_CANON(tty)) {
 			if (b-buf)
 				break;
 		} else if (b-buf >= minimum)
 			break;
 	}
-	current->alarm = oldalarm;
+	set_alarm(current,oldalarm);
 	if (current->signal && !(b-buf))
 		return -EINTR;
 	return (b-buf);
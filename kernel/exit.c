@@ -12,45 +12,51 @@
 #include <linux/kernel.h>
 #include <linux/tty.h>
 #include <asm/segment.h>
+#include <asm/system.h>
 
 int sys_pause(void);
 int sys_close(int fd);
 
 void release(struct task_struct * p)
 {
-	int i;
-
 	if (!p)
 		return;
-	for (i=1 ; i<NR_TASKS ; i++)
-		if (task[i]==p) {
-			task[i]=NULL;
-			free_page((long)p);
-			schedule();
-			return;
-		}
-	panic("trying to release non-existent task");
+	if (!p->nr || task[p->nr] != p)
+		panic("trying to release non-existent task");
+	cli();
+	REMOVE_LINKS(p);
+	sti();
+	unhash_pid(p);
+	task[p->nr]=NULL;
+	put_task_slot(p->nr);
+	free_page(p->tss.cr3);	/* do_exit() emptied it */
+	if (p->i387)
+		free_page((long) p->i387);
+	free_page((long)p);
+	schedule();
 }
 
 static inline int send_sig(long sig,struct task_struct * p,int priv)
 {
 	if (!p || sig<1 || sig>32)
 		return -EINVAL;
-	if (priv || (current->euid==p->euid) || suser())
+	if (priv || (current->euid==p->euid) || suser()) {
 		p->signal |= (1<<(sig-1));
-	else
+		signal_wake_up(p);
+	} else
 		return -EPERM;
 	return 0;
 }
 
 static void kill_session(void)
 {
-	struct task_struct **p = NR_TASKS + task;
+	struct task_struct *p;
 	
-	while (--p > &FIRST_TASK) {
-		if (*p && (*p)->session == current->session)
-			(*p)->signal |= 1<<(SIGHUP-1);
-	}
+	for_each_task(p)
+		if (p->session == current->session) {
+			p->signal |= 1<<(SIGHUP-1);
+			signal_wake_up(p);
+		}
 }
 
 /*
@@ -59,59 +65,75 @@ static void kill_session(void)
  */
 int sys_kill(int pid,int sig)
 {
-	struct task_struct **p = NR_TASKS + task;
+	struct task_struct *p;
 	int err, retval = 0;
 
-	if (!pid) while (--p > &FIRST_TASK) {
-		if (*p && (*p)->pgrp == current->pid) 
-			if (err=send_sig(sig,*p,1))
-				retval = err;
-	} else if (pid>0) while (--p > &FIRST_TASK) {
-		if (*p && (*p)->pid == pid) 
-			if (err=send_sig(sig,*p,0))
-				retval = err;
-	} else if (pid == -1) while (--p > &FIRST_TASK)
-		if (err = send_sig(sig,*p,0))
-			retval = err;
-	else while (--p > &FIRST_TASK)
-		if (*p && (*p)->pgrp == -pid)
-			if (err = send_sig(sig,*p,0))
+	if (pid>0) {
+		if (p = find_task_by_pid(pid))
+			retval = send_sig(sig,p,0);
+	} else if (!pid) {
+		for_each_task(p)
+			if (p->pgrp == current->pid) 
+				if (err=send_sig(sig,p,1))
+					retval = err;
+	} else if (pid == -1) {
+		for_each_task(p)
+			if (err = send_sig(sig,p,0))
 				retval = err;
+	} else {
+		for_each_task(p)
+			if (p->pgrp == -pid)
+				if (err = send_sig(sig,p,0))
+					retval = err;
+	}
 	return retval;
 }
 
-static void tell_father(int pid)
+static void tell_father(void)
 {
-	int i;
+	struct task_struct * p = current->p_pptr;
 
-	if (pid)
-		for (i=0;i<NR_TASKS;i++) {
-			if (!task[i])
-				continue;
-			if (task[i]->pid != pid)
-				continue;
-			task[i]->signal |= (1<<(SIGCHLD-1));
-			return;
-		}
+	if (p) {
+		p->signal |= (1<<(SIGCHLD-1));
+		signal_wake_up(p);
+		return;
+	}
 /* if we don't find any fathers, we just release ourselves */
 /* This is not really OK. Must change it to make father 1 */
 	printk("BAD BAD - no father found\n\r");
 	release(current);
 }
 
+/*
+ * Give our children to init (assumption task[1] is always init).
+ */
+static void forget_children(void)
+{
+	struct task_struct * p, * next;
+
+	cli();
+	for (p = current->p_cptr ; p ; p = next) {
+		next = p->p_osptr;
+		p->father = 1;
+		p->p_pptr = task[1];
+		p->p_ysptr = NULL;
+		if (p->p_osptr = task[1]->p_cptr)
+			p->p_osptr->p_ysptr = p;
+		task[1]->p_cptr = p;
+		if (p->state == TASK_ZOMBIE)
+			(void) send_sig(SIGCHLD, task[1], 1);
+	}
+	current->p_cptr = NULL;
+	sti();
+}
+
 int do_exit(long code)
 {
 	int i;
 
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
-	for (i=0 ; i<NR_TASKS ; i++)
-		if (task[i] && task[i]->father == current->pid) {
-			task[i]->father = 1;
-			if (task[i]->state == TASK_ZOMBIE)
-				/* assumption task[1] is always init */
-				(void) send_sig(SIGCHLD, task[1], 1);
-		}
+	free_page_tables(page_dir(current),get_base(current->ldt[1]),get_limit(0x0f));
+	free_page_tables(page_dir(current),get_base(current->ldt[2]),get_limit(0x17));
+	forget_children();
 	for (i=0 ; i<NR_OPEN ; i++)
 		if (current->filp[i])
 			sys_close(i);
@@ -127,9 +149,10 @@ int do_exit(long code)
 		last_task_used_math = NULL;
 	if (current->leader)
 		kill_session();
+	set_alarm(current,0);
 	current->state = TASK_ZOMBIE;
 	current->exit_code = code;
-	tell_father(current->father);
+	tell_father();
 	schedule();
 	return (-1);	/* just to suppress warnings */
 }
@@ -142,38 +165,34 @@ int sys_exit(int error_code)
 int sys_waitpid(pid_t pid,unsigned long * stat_addr, int options)
 {
 	int flag, code;
-	struct task_struct ** p;
+	struct task_struct * p;
 
 	verify_area(stat_addr,4);
 repeat:
 	flag=0;
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-		if (!*p || *p == current)
-			continue;
-		if ((*p)->father != current->pid)
-			continue;
+	for (p = current->p_cptr ; p ; p = p->p_osptr) {
 		if (pid>0) {
-			if ((*p)->pid != pid)
+			if (p->pid != pid)
 				continue;
 		} else if (!pid) {
-			if ((*p)->pgrp != current->pgrp)
+			if (p->pgrp != current->pgrp)
 				continue;
 		} else if (pid != -1) {
-			if ((*p)->pgrp != -pid)
+			if (p->pgrp != -pid)
 				continue;
 		}
-		switch ((*p)->state) {
+		switch (p->state) {
 			case TASK_STOPPED:
 				if (!(options & WUNTRACED))
 					continue;
 				put_fs_long(0x7f,stat_addr);
-				return (*p)->pid;
+				return p->pid;
 			case TASK_ZOMBIE:
-				current->cutime += (*p)->utime;
-				current->cstime += (*p)->stime;
-				flag = (*p)->pid;
-				code = (*p)->exit_code;
-				release(*p);
+				current->cutime += p->utime;
+				current->cstime += p->stime;
+				flag = p->pid;
+				code = p->exit_code;
+				release(p);
 				put_fs_long(code,stat_addr);
 				return flag;
 			default:
@@ -11,6 +11,7 @@
  * management can be a bitch. See 'mm/mm.c': 'copy_page_tables()'
  */
 #include <errno.h>
+#include <string.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -18,6 +19,7 @@
 #include <asm/system.h>
 
 extern void write_verify(unsigned long address);
+extern void ret_from_fork(void);
 
 long last_pid=0;
 
@@ -49,12 +51,16 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
-	new_data_base = new_code_base = nr * 0x4000000;
+	new_data_base = new_code_base = TASK_BASE;
 	p->start_code = new_code_base;
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
-		free_page_tables(new_data_base,data_limit);
+	if (!(p->tss.cr3 = new_page_dir()))
+		return -ENOMEM;
+	if (copy_page_tables(page_dir(current),old_data_base,
+	    page_dir(p),new_data_base,data_limit)) {
+		free_page_tables(page_dir(p),new_data_base,data_limit);
+		free_page(p->tss.cr3);
 		return -ENOMEM;
 	}
 	return 0;
@@ -73,10 +79,13 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	struct task_struct *p;
 	int i;
 	struct file *f;
+	long * stack;
 
 	p = (struct task_struct *) get_free_page();
-	if (!p)
+	if (!p) {
+		put_task_slot(nr);
 		return -EAGAIN;
+	}
 	task[nr] = p;
 	*p = *current;	/* NOTE! this doesn't copy the supervisor stack */
 	p->state = TASK_UNINTERRUPTIBLE;
@@ -85,63 +94,92 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->counter = p->priority;
 	p->signal = 0;
 	p->alarm = 0;
+	init_timer(&p->real_timer);
+	p->nr = nr;
+	p->rq_array = NULL;
+	p->next_run = p->prev_run = NULL;
+	p->p_pptr = current;
+	p->p_cptr = NULL;
+	memset(&p->sched_stat,0,sizeof(p->sched_stat));
 	p->leader = 0;		/* process leadership doesn't inherit */
 	p->utime = p->stime = 0;
 	p->cutime = p->cstime = 0;
 	p->start_time = jiffies;
-	p->tss.back_link = 0;
 	p->tss.esp0 = PAGE_SIZE + (long) p;
-	p->tss.ss0 = 0x10;
-	p->tss.eip = eip;
-	p->tss.eflags = eflags;
-	p->tss.eax = 0;
-	p->tss.ecx = ecx;
-	p->tss.edx = edx;
-	p->tss.ebx = ebx;
-	p->tss.esp = esp;
-	p->tss.ebp = ebp;
-	p->tss.esi = esi;
-	p->tss.edi = edi;
-	p->tss.es = es & 0xffff;
-	p->tss.cs = cs & 0xffff;
-	p->tss.ss = ss & 0xffff;
-	p->tss.ds = ds & 0xffff;
-	p->tss.fs = fs & 0xffff;
-	p->tss.gs = gs & 0xffff;
 	p->tss.ldt = _LDT(nr);
-	p->tss.trace_bitmap = 0x80000000;
-	if (last_task_used_math == current)
-		__asm__("clts ; fnsave %0"::"m" (p->tss.i387));
-	if (copy_mem(nr,p)) {
-		task[nr] = NULL;
-		free_page((long) p);
-		return -EAGAIN;
+	p->lock_depth = 1;	/* ret_from_sys_call lets go of it */
+/*
+ * The kernel stack of the child: what ret_from_sys_call pops to get
+ * back to user mode, with 0 as the return value, and below it the
+ * frame switch_to() leaves, returning to ret_from_fork.
+ */
+	stack = (long *) (PAGE_SIZE + (long) p);
+	*--stack = ss & 0xffff;
+	*--stack = esp;
+	*--stack = eflags;
+	*--stack = cs & 0xffff;
+	*--stack = eip;
+	*--stack = ds & 0xffff;
+	*--stack = es & 0xffff;
+	*--stack = fs & 0xffff;
+	*--stack = edx;
+	*--stack = ecx;
+	*--stack = ebx;
+	*--stack = 0;
+	*--stack = fs & 0xffff;
+	*--stack = gs & 0xffff;
+	*--stack = ebp;
+	*--stack = edi;
+	*--stack = esi;
+	*--stack = ebx;
+	*--stack = (long) ret_from_fork;
+	p->kesp = (long) stack;
+	p->fpu_counter = p->fpu_used = 0;
+	p->i387 = NULL;
+	if (current->used_math) {
+		if (!(p->i387 = (union i387_union *) get_free_page()))
+			goto bad_fork;
+		if (last_task_used_math == current) {
+			__asm__("clts");
+			save_fpu(p);
+		} else
+			*p->i387 = *current->i387;
 	}
+	if (copy_mem(nr,p))
+		goto bad_fork;
 	for (i=0; i<NR_OPEN;i++)
 		if (f=p->filp[i])
-			f->f_count++;
+			atomic_inc(&f->f_count);
 	if (current->pwd)
-		current->pwd->i_count++;
+		atomic_inc(&current->pwd->i_count);
 	if (current->root)
-		current->root->i_count++;
+		atomic_inc(&current->root->i_count);
 	if (current->executable)
-		current->executable->i_count++;
-	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
+		atomic_inc(&current->executable->i_count);
 	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
-	p->state = TASK_RUNNING;	/* do this last, just in case */
+	hash_pid(p);
+	cli();
+	SET_LINKS(p);
+	sti();
+	wake_up_process(p);	/* do this last, just in case */
 	return last_pid;
+bad_fork:
+	if (p->i387)
+		free_page((long) p->i387);
+	task[nr] = NULL;
+	put_task_slot(nr);
+	free_page((long) p);
+	return -EAGAIN;
 }
 
+/*
+ * Returns a free task slot, which copy_process() must either use or
+ * give back, and picks a pid nobody has.
+ */
 int find_empty_process(void)
 {
-	int i;
-
 	repeat:
 		if ((++last_pid)<0) last_pid=1;
-		for(i=0 ; i<NR_TASKS ; i++)
-			if (task[i] && task[i]->pid == last_pid) goto repeat;
-	for(i=1 ; i<NR_TASKS ; i++)
-		if (!task[i])
-			return i;
-	return -EAGAIN;
+		if (find_task_by_pid(last_pid)) goto repeat;
+	return get_task_slot();
 }
@@ -10,10 +10,15 @@
  * call functions (type getpid(), which just extracts a field from
  * current-task
  */
+#include <errno.h>
+
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/timer.h>
 #include <linux/sys.h>
 #include <linux/fdreg.h>     // 软驱头文件
+#include <linux/smp.h>
 #include <asm/system.h>
 #include <asm/io.h>
 #include <asm/segment.h>
@@ -30,6 +35,8 @@
 
 #define _BLOCKABLE (~(_S(SIGKILL) | _S(SIGSTOP)))
 
+volatile void do_exit(long code);
+
 // 显示任务号 nr 的进程号、进程状态和内核堆栈空闲字节数（大约）
 void show_task(int nr,struct task_struct * p)
 {
@@ -45,11 +52,11 @@ void show_task(int nr,struct task_struct * p)
 
 void show_stat(void)
 {
-	int i;
+	struct task_struct * p;
 
-	for (i=0;i<NR_TASKS;i++)
-		if (task[i])
-			show_task(i,task[i]);
+	show_task(0,task[0]);
+	for_each_task(p)
+		show_task(p->nr,p);
 }
 
 // 定义每个时间片的滴答数
@@ -76,12 +83,71 @@ static union task_union init_task = {INIT_TASK,};
 long volatile jiffies=0;
 long startup_time=0;
 // 初始化当前任务指针为初试进程
-struct task_struct *current = &(init_task.task);
-struct task_struct *last_task_used_math = NULL;
+struct task_struct *current_set[NR_CPUS] = {&(init_task.task), };
+struct task_struct *idle_set[NR_CPUS] = {&(init_task.task), };
+struct task_struct *math_owner[NR_CPUS] = {NULL, };
 
 // 初始化任务指针数组
 struct task_struct * task[NR_TASKS] = {&(init_task.task), };
 
+int max_tasks = MAX_TASKS;
+
+/*
+ * The free slots of task[] are kept on a stack, so fork doesn't have
+ * to look for one.
+ */
+static int free_slot[NR_TASKS];
+static int nr_free_slots = 0;
+
+int get_task_slot(void)
+{
+	if (!nr_free_slots)
+		return -EAGAIN;
+	return free_slot[--nr_free_slots];
+}
+
+void put_task_slot(int nr)
+{
+	free_slot[nr_free_slots++] = nr;
+}
+
+/*
+ * Tasks by pid. pid 0 (task 0) isn't in it.
+ */
+#define PIDHASH_SZ 64
+#define pid_hashfn(x) ((x) & (PIDHASH_SZ-1))
+
+static struct task_struct * pidhash[PIDHASH_SZ];
+
+struct task_struct * find_task_by_pid(long pid)
+{
+	struct task_struct * p;
+
+	for (p = pidhash[pid_hashfn(pid)] ; p ; p = p->pidhash_next)
+		if (p->pid == pid)
+			return p;
+	return NULL;
+}
+
+void hash_pid(struct task_struct * p)
+{
+	struct task_struct ** h = pidhash + pid_hashfn(p->pid);
+
+	p->pidhash_next = *h;
+	*h = p;
+}
+
+void unhash_pid(struct task_struct * p)
+{
+	struct task_struct ** h = pidhash + pid_hashfn(p->pid);
+
+	for ( ; *h ; h = &(*h)->pidhash_next)
+		if (*h == p) {
+			*h = p->pidhash_next;
+			return;
+		}
+}
+
 // 定义用户堆栈，PAGE_SIZE>>2 = 1024
 long user_stack [ PAGE_SIZE>>2 ] ;
 
@@ -90,6 +156,82 @@ struct {
 	long * a;
 	short b;
 	} stack_start = { & user_stack [PAGE_SIZE>>2] , 0x10 };
+/*
+ * Scheduler statistics, for all tasks (task 0, the idle task, isn't
+ * counted). Per-task ones are in the task structure.
+ */
+static struct schedstat sched_stats;
+
+/*
+ * The math state is switched lazily: the fpu keeps the state of the
+ * last task that used it, and switching tasks sets TS, so that the
+ * next task to use the fpu traps to math_state_restore(). Tasks that
+ * never touch the fpu thus never pay for it.
+ *
+ * The state is kept in task->i387, a page the task gets when it first
+ * uses the fpu, so that it doesn't take room from the kernel stack. On
+ * cpus with fxsave/fxrstor (they are used if cpuid says so) it includes
+ * the SSE registers; on others fnsave/frstor are used. fxsave and
+ * friends are given as bytes, with the address in %eax, for older
+ * assemblers.
+ *
+ * A task that has used the fpu in FPU_EAGER time slices in a row gets
+ * its state loaded as soon as it's switched to (see schedule()), so it
+ * doesn't take the trap every time. fpu_counter is a char: it wraps
+ * after 256 such slices, and the task goes back to the trap once, to
+ * see if it still uses the fpu.
+ */
+#define FPU_EAGER 5
+
+static int has_fxsr = 0;
+static struct i387_fxsave_struct init_fxsave;
+
+#define fxsave(p) \
+__asm__("fwait ; .byte 0x0f,0xae,0x00"::"a" (&(p)->i387->fxsave):"memory")
+#define fxrstor(x) \
+__asm__(".byte 0x0f,0xae,0x08"::"a" (x):"memory")
+
+void save_fpu(struct task_struct * p)
+{
+	if (has_fxsr)
+		fxsave(p);
+	else
+		__asm__("fnsave %0 ; frstor %0"::"m" (p->i387->fsave));
+}
+
+/*
+ * Make current the owner of the fpu, saving the state of the last
+ * owner. TS must be clear, and current must have its i387 page.
+ */
+static void load_fpu(void)
+{
+	__asm__("fwait");
+	// 如果上一个任务使用了协处理器，则保存其状态
+	if (last_task_used_math) {
+		if (has_fxsr)
+			fxsave(last_task_used_math);
+		else
+			__asm__("fnsave %0"::"m" (last_task_used_math->i387->fsave));
+	}
+	// 将当前任务设置为上一个任务，为被交换出去做准备
+	last_task_used_math=current;
+	// 当前任务使用了协处理器，则恢复其状态，没有则初始化，并设置标志位
+	if (current->used_math) {
+		if (has_fxsr)
+			fxrstor(&current->i387->fxsave);
+		else
+			__asm__("frstor %0"::"m" (current->i387->fsave));
+	} else {
+		if (has_fxsr)
+			fxrstor(&init_fxsave);
+		else
+			__asm__("fninit"::);
+		current->used_math=1;
+	}
+	current->fpu_counter++;
+	current->fpu_used = 1;
+}
+
 /*
  *  'math_state_restore()' saves the current math information in the
  * old math state array, and gets the new ones from the current task
@@ -99,104 +241,479 @@ struct {
 // 当前任务的协处理器执行状态
 void math_state_restore()
 {
+	current->sched_stat.ss_fpu_traps++;
+	sched_stats.ss_fpu_traps++;
 	// 上一个任务(刚被交换出去的任务)就是当前任务，则直接返回
 	if (last_task_used_math == current)
 		return;
-	__asm__("fwait");
-	// 如果上一个任务使用了协处理器，则保存其状态
-	if (last_task_used_math) {
-		__asm__("fnsave %0"::"m" (last_task_used_math->tss.i387));
+	if (!current->i387) {
+		if (!(current->i387 = (union i387_union *) get_free_page())) {
+			printk("out of memory\n\r");
+			do_exit(SIGSEGV);
+		}
+		__asm__("clts");	/* we may have slept, and TS be set */
 	}
-	// 将当前任务设置为上一个任务，为被交换出去做准备
-	last_task_used_math=current;
-	// 当前任务使用了协处理器，则保存其状态，没有则初始化，并设置标志位
-	if (current->used_math) {
-		__asm__("frstor %0"::"m" (current->tss.i387));
+	load_fpu();
+}
+
+/*
+ * The feature flags cpuid gives, or 0 if the cpu hasn't got cpuid (the
+ * ID flag can't be changed).
+ */
+unsigned long cpu_features(void)
+{
+	unsigned long flags, features;
+
+	__asm__("pushfl ; popl %0":"=r" (flags));
+	__asm__("pushl %0 ; popfl"::"r" (flags ^ 0x200000));
+	__asm__("pushfl ; popl %0":"=r" (features));
+	__asm__("pushl %0 ; popfl"::"r" (flags));
+	if (!((features ^ flags) & 0x200000))
+		return 0;
+	__asm__(".byte 0x0f,0xa2"		/* cpuid */
+		:"=d" (features):"a" (1):"bx","cx");
+	return features;
+}
+
+/*
+ * Called from sched_init(). head.s has set EM if there is no
+ * coprocessor: then there is nothing to do. Otherwise, if cpuid says
+ * the cpu has fxsr, we turn on OSFXSR in cr4, and keep the state of a
+ * freshly initialised fpu for tasks that start using it.
+ */
+static void fpu_init(void)
+{
+	unsigned long cr0;
+
+	__asm__("movl %%cr0,%0":"=r" (cr0));
+	if (cr0 & 4)
+		return;
+	if (!(cpu_features() & 0x1000000))
+		return;
+	__asm__(".byte 0x0f,0x20,0xe0\n\t"	/* movl %cr4,%eax */
+		"orl $0x200,%%eax\n\t"
+		".byte 0x0f,0x22,0xe0"		/* movl %eax,%cr4 */
+		:::"ax");
+	has_fxsr = 1;
+	__asm__("clts ; fninit");
+	__asm__(".byte 0x0f,0xae,0x00"::"a" (&init_fxsave):"memory");
+	printk("Using fxsave/fxrstor for the math state\n\r");
+}
+
+/*
+ * The run queues, one per cpu. Runnable tasks are kept on one of two
+ * priority arrays, on the list for their counter (time left in ticks),
+ * so the task with the largest counter is found from the bitmap without
+ * looking at the others. 'active' holds the tasks that still have time
+ * left in this epoch, 'expired' the ones that have used theirs up: these
+ * already have their counter for the next epoch. When the active array
+ * is empty the two are swapped, and a new epoch begins.
+ *
+ * The old scheduler gave every task counter = counter/2 + priority at
+ * the start of an epoch, sleeping ones included, so that IO-bound
+ * tasks get a bonus. This is still done, but for a sleeping task only
+ * when it wakes up: once per epoch it missed (see catch_up()).
+ *
+ * The current task stays on its list while it runs, and is requeued
+ * by schedule(). Tasks that go to sleep are taken off there too, so
+ * the only other place tasks are queued is wake_up_process(), on the
+ * queue of the cpu they last ran on. A cpu that runs out of tasks, or
+ * that starts a new epoch with fewer than another, takes one from the
+ * busiest queue (see steal_task()). The run queues are protected by
+ * the kernel lock.
+ */
+#define NR_PRIO 64		/* counters above this share the last list */
+
+struct prio_array {
+	int nr_active;
+	unsigned long bitmap[NR_PRIO/32];
+	struct task_struct * queue[NR_PRIO];
+};
+
+struct runqueue {
+	struct prio_array arrays[2];
+	struct prio_array * active, * expired;
+	long epoch;
+};
+
+static struct runqueue runqueues[NR_CPUS];
+
+#define nr_running(rq) ((rq)->active->nr_active + (rq)->expired->nr_active)
+
+static inline int find_last_bit(unsigned long * map)
+{
+	int i,bit;
+
+	for (i = NR_PRIO/32-1 ; i >= 0 ; i--)
+		if (map[i]) {
+			__asm__("bsrl %1,%0":"=r" (bit):"r" (map[i]));
+			return (i<<5)+bit;
+		}
+	return -1;
+}
+
+static void enqueue_task(struct task_struct * p, struct prio_array * array)
+{
+	int prio = (p->counter < NR_PRIO) ? p->counter : NR_PRIO-1;
+	struct task_struct * head = array->queue[prio];
+
+	if (!head) {
+		array->queue[prio] = p->next_run = p->prev_run = p;
+		array->bitmap[prio>>5] |= 1 << (prio & 31);
 	} else {
-		__asm__("fninit"::);
-		current->used_math=1;
+		p->next_run = head;
+		p->prev_run = head->prev_run;
+		head->prev_run->next_run = p;
+		head->prev_run = p;
 	}
+	p->rq_prio = prio;
+	p->rq_array = array;
+	array->nr_active++;
+}
+
+static void dequeue_task(struct task_struct * p)
+{
+	struct prio_array * array = p->rq_array;
+	int prio = p->rq_prio;
+
+	if (p->next_run == p) {
+		array->queue[prio] = NULL;
+		array->bitmap[prio>>5] &= ~(1 << (prio & 31));
+	} else {
+		p->prev_run->next_run = p->next_run;
+		p->next_run->prev_run = p->prev_run;
+		if (array->queue[prio] == p)
+			array->queue[prio] = p->next_run;
+	}
+	p->next_run = p->prev_run = NULL;
+	p->rq_array = NULL;
+	array->nr_active--;
+}
+
+/*
+ * Give a task that has been asleep the counter it would have got at
+ * the start of each epoch it missed. The counter converges to about
+ * 2*priority within a few rounds, so that's all we do.
+ */
+static void catch_up(struct runqueue * rq, struct task_struct * p)
+{
+	long n = rq->epoch - p->epoch;
+
+	if (n <= 0)
+		return;
+	if (n > 8)
+		n = 8;
+	while (n--)
+		p->counter = (p->counter >> 1) + p->priority;
+	p->epoch = rq->epoch;
 }
 
 /*
- *  'schedule()' is the scheduler function. This is GOOD CODE! There
- * probably won't be any reason to change this, as it should work well
- * in all circumstances (ie gives IO-bound processes good response etc).
- * The one thing you might take a look at is the signal-handler code here.
+ * Put a runnable task on the run queue of its cpu. One that has no
+ * time left gets its counter for the next epoch, and waits for that.
+ */
+static void queue_task(struct task_struct * p)
+{
+	struct runqueue * rq = runqueues + p->cpu;
+
+	if (p->epoch > rq->epoch) {
+		enqueue_task(p,rq->expired);
+		return;
+	}
+	catch_up(rq,p);
+	if (p->counter > 0) {
+		enqueue_task(p,rq->active);
+		return;
+	}
+	p->counter = p->priority;
+	p->epoch = rq->epoch+1;
+	enqueue_task(p,rq->expired);
+}
+
+/*
+ * The tasks on the queue of cpu that aren't running there.
+ */
+static int nr_waiting(int cpu)
+{
+	struct task_struct * curr = current_set[cpu];
+
+	if (!curr)
+		return 0;
+	return nr_running(runqueues+cpu) - (curr->rq_array != NULL);
+}
+
+/*
+ * A task on the array that isn't running, the one with most time left.
+ */
+static struct task_struct * find_waiting(struct prio_array * array)
+{
+	struct task_struct * p;
+	int prio;
+
+	for (prio = NR_PRIO-1 ; prio >= 0 ; prio--) {
+		if (!(p = array->queue[prio]))
+			continue;
+		do {
+			if (p != current_set[p->cpu])
+				return p;
+		} while ((p = p->next_run) != array->queue[prio]);
+	}
+	return NULL;
+}
+
+/*
+ * Move a waiting task from the busiest other queue to that of cpu, if
+ * it has at least 'imbalance' more of them. Its epoch is made relative
+ * to the new queue, so what it has missed (or already got) stays the
+ * same.
+ */
+static int steal_task(int cpu, int imbalance)
+{
+	struct runqueue * rq, * from;
+	struct task_struct * p;
+	int i, n, busiest = -1, most = 0;
+
+	if (smp_num_cpus < 2)
+		return 0;
+	n = nr_waiting(cpu);
+	for (i = 0 ; i < smp_num_cpus ; i++)
+		if (i != cpu && nr_waiting(i) > most) {
+			most = nr_waiting(i);
+			busiest = i;
+		}
+	if (busiest < 0 || most - n < imbalance)
+		return 0;
+	rq = runqueues + cpu;
+	from = runqueues + busiest;
+	if (!(p = find_waiting(from->active)) &&
+	    !(p = find_waiting(from->expired)))
+		return 0;
+	dequeue_task(p);
+	p->epoch += rq->epoch - from->epoch;
+	p->cpu = cpu;
+	queue_task(p);
+	p->sched_stat.ss_migrations++;
+	sched_stats.ss_migrations++;
+	return 1;
+}
+
+/*
+ * A task has been queued on cpu. If that cpu is idle, it may be halted
+ * with no tick to wake it up (see cpu_idle()), so it is sent an
+ * interrupt. If it is busy, an idle one is, to come and take the task.
+ * When this cpu is idle, it will look for work itself.
+ */
+static void kick_idle_cpu(int cpu)
+{
+	int i, me = smp_processor_id();
+
+	if (smp_num_cpus < 2 || is_idle(current_set[me]))
+		return;
+	if (is_idle(current_set[cpu])) {
+		smp_send_reschedule(cpu);
+		return;
+	}
+	for (i = 0 ; i < smp_num_cpus ; i++)
+		if (i != me && is_idle(current_set[i]) &&
+		    !nr_running(runqueues+i)) {
+			smp_send_reschedule(i);
+			return;
+		}
+}
+
+static struct task_struct * pick_next_task(int cpu)
+{
+	struct runqueue * rq = runqueues + cpu;
+	struct prio_array * tmp;
+
+	if (!nr_running(rq) && !steal_task(cpu,1))
+		return idle_set[cpu];
+	if (!rq->active->nr_active) {
+		tmp = rq->active;
+		rq->active = rq->expired;
+		rq->expired = tmp;
+		rq->epoch++;
+		steal_task(cpu,2);
+	}
+	return rq->active->queue[find_last_bit(rq->active->bitmap)];
+}
+
+/*
+ *  'schedule()' is the scheduler function. It picks the runnable task
+ * with the most time left, as it always has, but no longer looks at
+ * every task to do so: see the run queue above. Alarms are handled by
+ * do_timer(), and signals wake up the task they are sent to (see
+ * signal_wake_up()).
  *
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
- * information in task[0] is never used.
+ * information in task[0] is never used, and it is never on the run
+ * queue. The same goes for the idle tasks of the other cpus.
  */
 
-/*schedule()函数首先对所有任务（进程）进行检测，唤醒任何一个已经得到信号的任务。具体方法是
- *针对任务数组中的每个任务，检查其报警定时值 alarm。如果任务的 alarm 时间已经过期(alarm<jiffies),
- *则在它的信号位图中设置 SIGALRM 信号，然后清 alarm 值。jiffies 是系统从开机开始算起的滴答数（10ms/
- *滴答）。在 sched.h 中定义。如果进程的信号位图中除去被阻塞的信号外还有其它信号，并且任务处于
- *可中断睡眠状态（TASK_INTERRUPTIBLE），则置任务为就绪状态（TASK_RUNNING）
+/*
+ *注意！！任务 0 是个闲置('idle')任务，只有当没有其它任务可以运行时才调用它。它不能被杀
+ *死，也不能睡眠。任务 0 中的状态信息'state'是从来不用的
  */
 
+static inline void sched_hist(long * hist, long ticks)
+{
+	int n = 0;
+
+	if (ticks > 0) {
+		__asm__("bsrl %1,%0":"=r" (n):"r" (ticks));
+		n++;
+	}
+	if (n >= SCHED_HIST)
+		n = SCHED_HIST-1;
+	hist[n]++;
+}
+
 /*
- *随后是调度函数的核心处理部分。这部分代码根据进程的时间片和优先权调度机制，来选择随后要
- *执行的任务。它首先循环检查任务数组中的所有任务，根据每个就绪态任务剩余执行时间的值 counter，
- *选取该值最大的一个任务，并利用 switch_to()函数切换到该任务。若所有就绪态任务的该值都等于零，
- *表示此刻所有任务的时间片都已经运行完，于是就根据任务的优先权值 priority，重置每个任务的运行时
- *间片值 counter，再重新执行循环检查所有任务的执行时间片值。
+ * Account for the switch from prev to next. Called with interrupts
+ * disabled, when prev is no longer running.
  */
+static void sched_account(struct task_struct * prev, struct task_struct * next)
+{
+	long t;
+
+	if (!is_idle(prev)) {
+		if (!prev->fpu_used)
+			prev->fpu_counter = 0;
+		prev->fpu_used = 0;
+		t = jiffies - prev->sched_start;
+		sched_hist(prev->sched_stat.ss_slice,t);
+		sched_hist(sched_stats.ss_slice,t);
+		if (prev->state == TASK_RUNNING) {
+			prev->sched_stat.ss_involuntary++;
+			sched_stats.ss_involuntary++;
+		} else {
+			prev->sched_stat.ss_voluntary++;
+			sched_stats.ss_voluntary++;
+		}
+	}
+	if (is_idle(next))
+		return;
+	t = jiffies - next->sched_ready;
+	next->sched_start = jiffies;
+	next->sched_stat.ss_runs++;
+	sched_stats.ss_runs++;
+	next->sched_stat.ss_run_delay += t;
+	sched_stats.ss_run_delay += t;
+	sched_hist(next->sched_stat.ss_wait,t);
+	sched_hist(sched_stats.ss_wait,t);
+	if (next->sched_woken) {
+		sched_hist(next->sched_stat.ss_wakeup,t);
+		sched_hist(sched_stats.ss_wakeup,t);
+		if (t > next->sched_stat.ss_max_wakeup)
+			next->sched_stat.ss_max_wakeup = t;
+		if (t > sched_stats.ss_max_wakeup)
+			sched_stats.ss_max_wakeup = t;
+	}
+}
 
 /*
- *注意！！任务 0 是个闲置('idle')任务，只有当没有其它任务可以运行时才调用它。它不能被杀
- *死，也不能睡眠。任务 0 中的状态信息'state'是从来不用的
+ * The second half of switch_to(), called on the kernel stack of next
+ * with interrupts disabled. Everything a task switch through the tss
+ * did for us is done by hand here: the tss of the cpu gets the kernel
+ * stack of next for its ring transitions (the top of its task page:
+ * the tss is the one of the idle task, so its own esp0 can't be
+ * trusted), and the ldt, page directory and TS-flag are set for it.
+ * %fs and %gs still hold the descriptors of the old ldt, until
+ * switch_to() pops them.
+ *
+ * With more than one cpu the math state can't stay in the fpu when
+ * its owner is switched out, as it may go on running on another cpu:
+ * so it's saved here. The cpu keeps the kernel lock, at the depth of
+ * next.
  */
+void __switch_to(struct task_struct * next)
+{
+	int cpu = smp_processor_id();
+	struct task_struct * prev = current_set[cpu];
+
+	if (smp_num_cpus > 1 && math_owner[cpu] == prev) {
+		save_fpu(prev);
+		math_owner[cpu] = NULL;
+	}
+	prev->lock_depth = kernel_depth;
+	kernel_depth = next->lock_depth;
+	current_set[cpu] = next;
+	idle_set[cpu]->tss.esp0 = PAGE_SIZE + (long) next;
+	lldt(next->nr);
+	if (next->tss.cr3 != prev->tss.cr3)
+		__asm__("movl %0,%%cr3"::"r" (next->tss.cr3));
+	if (math_owner[cpu] == next)
+		__asm__("clts");
+	else
+		__asm__("movl %%cr0,%%eax ; orl $8,%%eax ; movl %%eax,%%cr0"
+			:::"ax");
+}
 
 void schedule(void)
 {
-	int i,next,c;
-	struct task_struct ** p;
-
-/* check alarm, wake up any interruptible tasks that have got a signal */
-
-	// 如果设置过任务的定时值 alarm，并且已经过期(alarm<jiffies),则在信号位图中置 SIGALRM 信号，
-	// 即向任务发送 SIGALARM 信号。然后清 alarm。该信号的默认操作是终止进程
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if (*p) {
-			if ((*p)->alarm && (*p)->alarm < jiffies) {
-					(*p)->signal |= (1<<(SIGALRM-1));
-					(*p)->alarm = 0;
-				}
-			// 如果信号位图中除被阻塞的信号外还有其它信号，并且任务处于可中断状态，则置任务为就绪状态。
-			// 其中'~(_BLOCKABLE & (*p)->blocked)'用于忽略被阻塞的信号，但 SIGKILL 和 SIGSTOP 不能被阻塞。
-			if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-			(*p)->state==TASK_INTERRUPTIBLE)
-				(*p)->state=TASK_RUNNING;
-		}
+	struct task_struct * next;
+	unsigned long flags;
+	int cpu = smp_processor_id();
 
-/* this is the scheduler proper: */
-
-	while (1) {
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-		// 这段代码也是从任务数组的最后一个任务开始循环处理，并跳过不含任务的数组槽。比较每个就绪
-		// 状态任务的 counter（任务运行时间的递减滴答计数）值，哪一个值大，即运行时间还不长，next 就
-		// 指向哪个的任务号
-		while (--i) {
-			if (!*--p)
-				continue;
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-				c = (*p)->counter, next = i;
+	save_flags(flags);
+	cli();
+/* an interruptible sleep with a signal pending doesn't sleep at all */
+	if (current->state == TASK_INTERRUPTIBLE &&
+	    (current->signal & ~(_BLOCKABLE & current->blocked)))
+		current->state = TASK_RUNNING;
+	if (current->rq_array)
+		dequeue_task(current);
+	if (current->state == TASK_RUNNING && !is_idle(current)) {
+		current->sched_ready = jiffies;
+		current->sched_woken = 0;
+		queue_task(current);
+	}
+	next = pick_next_task(cpu);
+	if (next != current) {
+		sched_account(current,next);
+		switch_to(next);
+/* we are now 'next': load its math state if it's going to want it */
+		if (current->fpu_counter > FPU_EAGER &&
+		    last_task_used_math != current) {
+			__asm__("clts");
+			load_fpu();
+			current->sched_stat.ss_fpu_eager++;
+			sched_stats.ss_fpu_eager++;
 		}
-		// 如果有counter大于0的结果，则执行switch_to(next)进行进程调度
-		if (c) break;
-		// 否则就根据每个任务的优先权值，更新每一个任务的 counter 值，然后重新比较。
-		// counter 值的计算方式为 counter = counter /2 + priority。这里计算过程不考虑进程的状态。
-		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-			if (*p)
-				(*p)->counter = ((*p)->counter >> 1) +
-						(*p)->priority;
 	}
-	switch_to(next);
+	restore_flags(flags);
+}
+
+/*
+ * Make a task runnable, and queue it if it isn't already (a task that
+ * has set its state but not yet called schedule() is still queued).
+ */
+void wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (!p->rq_array && !is_idle(p)) {
+		p->sched_ready = jiffies;
+		p->sched_woken = 1;
+		queue_task(p);
+		kick_idle_cpu(p->cpu);
+	}
+	restore_flags(flags);
+}
+
+/*
+ * Called after a signal has been posted to a task: if it is in an
+ * interruptible sleep and the signal isn't blocked, it wakes up.
+ */
+void signal_wake_up(struct task_struct * p)
+{
+	if ((p->signal & ~(_BLOCKABLE & p->blocked)) &&
+	    p->state == TASK_INTERRUPTIBLE)
+		wake_up_process(p);
 }
 
 // pause()系统调用。转换当前任务的状态为可中断的等待状态，并重新调度
@@ -204,8 +721,16 @@ void schedule(void)
 // 一个信号捕获函数。只有当捕获了一个信号，并且信号捕获处理函数返回，pause()才会返回。
 // 此时 pause()返回值应该是-1，并且 errno 被置为 EINTR
 
+/*
+ * For task 0, pause() is the idle loop: see cpu_idle().
+ */
 int sys_pause(void)
 {
+	if (current == task[0]) {
+		cpu_idle();
+		schedule();
+		return 0;
+	}
 	current->state = TASK_INTERRUPTIBLE;
 	schedule();
 	return 0;
@@ -214,62 +739,120 @@ int sys_pause(void)
 /*
  *sleep_on()函数的主要功能是当一个进程（或任务）所请求的资源正忙或不在内存中时暂时切换出去，放在等待队列中等待一段时间
  *或者是访问互斥资源时，资源被另外进程占用，当前进程就需要休眠
- *当切换回来后再继续运行。放入等待队列的方式是利用了函数中的 tmp 指针作为各个正在等待任务的联系
+ *当切换回来后再继续运行。
  */
 
-// 把当前任务置为不可中断的等待状态，并让睡眠队列头的指针指向当前任务
-// 只有明确地唤醒时才会返回。该函数提供了进程与中断处理程序之间的同步机制
-// 这个很关键：函数参数*p是放置等待任务的队列头指针
+/*
+ * Non-exclusive waiters go at the head of the queue, exclusive ones at
+ * the tail, so wake_up() can stop at the first exclusive one it wakes.
+ * Called with interrupts disabled.
+ */
+static void add_wait_queue(struct wait_queue ** p, struct wait_queue * wait)
+{
+	if (!wait->exclusive) {
+		wait->next = *p;
+		*p = wait;
+		return;
+	}
+	while (*p)
+		p = &(*p)->next;
+	wait->next = NULL;
+	*p = wait;
+}
+
+static void remove_wait_queue(struct wait_queue ** p, struct wait_queue * wait)
+{
+	for ( ; *p ; p = &(*p)->next)
+		if (*p == wait) {
+			*p = wait->next;
+			return;
+		}
+}
 
-void sleep_on(struct task_struct **p)
+/*
+ * The queue entry lives on our stack: we take it off the queue again
+ * ourselves when we wake up, so wake_up() never has to. If 'lock' is
+ * given the caller holds it, and it is let go of only once we are on
+ * the queue: whoever changes what we wait for under the lock can't
+ * wake up the queue before we are on it. We have it again on return.
+ */
+static void __sleep_on(struct wait_queue ** p, int state, int exclusive,
+	spinlock_t * lock)
 {
-	struct task_struct *tmp;
+	struct wait_queue wait;
+	unsigned long flags;
 
 	if (!p)
 		return;
-	if (current == &(init_task.task))
+	if (is_idle(current))
 		panic("task[0] trying to sleep");
-	tmp = *p;
-	*p = current;       // 将等待队列头的指针指向当前任务
-	current->state = TASK_UNINTERRUPTIBLE;
+	wait.task = current;
+	wait.exclusive = exclusive;
+	save_flags(flags);
+	cli();
+	add_wait_queue(p,&wait);
+	current->state = state;
+	if (lock)
+		spin_unlock(lock);
 	schedule();
-	if (tmp)
-		tmp->state=0;   // 进程状态设置为就绪，即TASK_RUNNING
+	if (lock)
+		spin_lock(lock);
+	remove_wait_queue(p,&wait);
+	restore_flags(flags);
 }
 
-// 将当前任务置为可中断的等待状态，并放入*p 指定的等待队列中
+// 把当前任务置为不可中断的等待状态，并放入*p 指定的等待队列中
+// 只有明确地唤醒时才会返回。该函数提供了进程与中断处理程序之间的同步机制
 
-void interruptible_sleep_on(struct task_struct **p)
+void sleep_on(struct wait_queue **p)
 {
-	struct task_struct *tmp;
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,0,NULL);
+}
 
-	if (!p)
-		return;
-	if (current == &(init_task.task))
-		panic("task[0] trying to sleep");
-	tmp=*p;
-	*p=current;
-repeat:	current->state = TASK_INTERRUPTIBLE;
-	schedule();
-	// 如果等待队列中还有等待任务，并且队列头指针所指向的任务不是当前任务时，则将该等待任务置为
-	// 可运行的就绪状态，并重新执行调度程序。当指针*p 所指向的不是当前任务时，表示在当前任务被放
-	// 入队列后，又有新的任务被插入等待队列中，因此，就应该同时也将所有其它的等待任务置为可运行
-	// 状态
-	if (*p && *p != current) {
-		(**p).state=0;
-		goto repeat;
-	}
-	*p=NULL;
-	if (tmp)
-		tmp->state=0;
+void sleep_on_exclusive(struct wait_queue **p)
+{
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,1,NULL);
+}
+
+void sleep_on_locked(struct wait_queue **p, spinlock_t * lock)
+{
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,0,lock);
+}
+
+void sleep_on_exclusive_locked(struct wait_queue **p, spinlock_t * lock)
+{
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,1,lock);
+}
+
+// 将当前任务置为可中断的等待状态，并放入*p 指定的等待队列中
+
+void interruptible_sleep_on(struct wait_queue **p)
+{
+	__sleep_on(p,TASK_INTERRUPTIBLE,0,NULL);
 }
 
-void wake_up(struct task_struct **p)
+/*
+ * Waiters that are already running (woken before, or by a signal) but
+ * haven't yet taken themselves off the queue are skipped: in particular
+ * they don't count as the exclusive waiter woken.
+ */
+void wake_up(struct wait_queue **p)
 {
-	if (p && *p) {
-		(**p).state=0;
-		*p=NULL;
+	struct wait_queue * tmp;
+	unsigned long flags;
+
+	if (!p)
+		return;
+	save_flags(flags);
+	cli();
+	for (tmp = *p ; tmp ; tmp = tmp->next) {
+		if (tmp->task->state == TASK_RUNNING)
+			continue;
+		wake_up_process(tmp->task);
+		if (tmp->exclusive)
+			break;
 	}
+	restore_flags(flags);
 }
 
 /*
@@ -277,7 +860,7 @@ void wake_up(struct task_struct **p)
  * proper. They are here because the floppy needs a timer, and this
  * was the easiest way of doing it.
  */
-static struct task_struct * wait_motor[4] = {NULL,NULL,NULL,NULL};
+static struct wait_queue * wait_motor[4] = {NULL,NULL,NULL,NULL};
 static int  mon_timer[4]={0,0,0,0};
 static int moff_timer[4]={0,0,0,0};
 unsigned char current_DOR = 0x0C;
@@ -289,7 +872,7 @@ int ticks_to_floppy_on(unsigned int nr)
 
 	if (nr>3)
 		panic("floppy_on: nr>3");
-	moff_timer[nr]=10000;		/* 100 s = very big :-) */
+	moff_timer[nr]=100*HZ;		/* 100 s = very big :-) */
 	cli();				/* use floppy_off to turn it off */
 	mask |= current_DOR;
 	if (!selected) {
@@ -300,8 +883,8 @@ int ticks_to_floppy_on(unsigned int nr)
 		outb(mask,FD_DOR);
 		if ((mask ^ current_DOR) & 0xf0)
 			mon_timer[nr] = HZ/2;
-		else if (mon_timer[nr] < 2)
-			mon_timer[nr] = 2;
+		else if (mon_timer[nr] < (HZ+49)/50)
+			mon_timer[nr] = (HZ+49)/50;
 		current_DOR = mask;
 	}
 	sti();
@@ -340,90 +923,233 @@ void do_floppy_timer(void)
 	}
 }
 
-#define TIME_REQUESTS 64
+/*
+ * The alarm of a task is a timer of its own.
+ */
+static void it_real_fn(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	p->alarm = 0;
+	p->signal |= (1<<(SIGALRM-1));
+	signal_wake_up(p);
+}
+
+/*
+ * Set (or with 0, clear) the alarm of p: it goes off when jiffies
+ * has passed 'when'.
+ */
+void set_alarm(struct task_struct * p, long when)
+{
+	del_timer(&p->real_timer);
+	if (p->alarm = when) {
+		p->real_timer.function = it_real_fn;
+		p->real_timer.data = (unsigned long) p;
+		mod_timer(&p->real_timer,when+1);
+	}
+}
+
+extern int beepcount;
+
+#ifdef TICKLESS
+/*
+ * Tickless idle: when the idle task halts, the PIT is put in one-shot
+ * mode (mode 0) for as many ticks as the timer wheel can wait, and
+ * put back to periodic ticks (mode 3) by the first interrupt. If that
+ * is the one-shot one, all the ticks have passed; otherwise we read
+ * how far the counter got, rounding to the nearest tick. The skipped
+ * ticks are added to jiffies and to the idle time of task 0.
+ *
+ * Another interrupt can wake us just as the one-shot goes off. The
+ * read-back command gives the OUT pin with the count: if it is high,
+ * the timer interrupt is still to come and counts the last tick.
+ *
+ * The floppy motor timers and the console beep count in ticks, so the
+ * tick isn't stopped while they run. Nor is it while another cpu has
+ * tasks to run, as they need the time to go on. When the others are
+ * idle too, only cpu 0 can give them work (the 8259 interrupts and the
+ * timers all come here), and it restarts the tick first. The other
+ * cpus stop their local APIC tick instead: see stop_local_tick().
+ *
+ * Kernel timers still count in ticks. For finer ones, raise HZ: an
+ * idle cpu doesn't take the extra interrupts.
+ */
+#define PIT_MAX_TICKS (0xffff/LATCH)
+
+static long tick_stopped = 0;	/* ticks programmed, 0 if periodic */
+
+static int others_busy(void)
+{
+	int cpu;
 
-static struct timer_list {
-	long jiffies;
-	void (*fn)();
-	struct timer_list * next;
-} timer_list[TIME_REQUESTS], * next_timer = NULL;
+	for (cpu = 1 ; cpu < smp_num_cpus ; cpu++)
+		if (!is_idle(current_set[cpu]) || nr_running(runqueues+cpu))
+			return 1;
+	return 0;
+}
 
-void add_timer(long jiffies, void (*fn)(void))
+static void stop_tick(void)
 {
-	struct timer_list * p;
+	long ticks, count;
 
-	if (!fn)
+	if (beepcount || (current_DOR & 0xf0) || others_busy())
 		return;
-	cli();
-	if (jiffies <= 0)
-		(fn)();
+	if ((ticks = next_timer_ticks(PIT_MAX_TICKS)) < 2)
+		return;
+	count = ticks*LATCH;
+	outb_p(0x30,0x43);		/* binary, mode 0, LSB/MSB, ch 0 */
+	outb_p(count & 0xff , 0x40);
+	outb(count >> 8 , 0x40);
+	tick_stopped = ticks;
+}
+
+/*
+ * 'fired' is set when called from do_timer(), which counts the last
+ * tick itself. Called with interrupts disabled.
+ */
+static void restart_tick(int fired)
+{
+	long ticks = tick_stopped, count, status;
+
+	if (!ticks)
+		return;
+	tick_stopped = 0;
+	if (fired)
+		ticks--;
 	else {
-		for (p = timer_list ; p < timer_list + TIME_REQUESTS ; p++)
-			if (!p->fn)
-				break;
-		if (p >= timer_list + TIME_REQUESTS)
-			panic("No more time requests free");
-		p->fn = fn;
-		p->jiffies = jiffies;
-		p->next = next_timer;
-		next_timer = p;
-		while (p->next && p->next->jiffies < p->jiffies) {
-			p->jiffies -= p->next->jiffies;
-			fn = p->fn;
-			p->fn = p->next->fn;
-			p->next->fn = fn;
-			jiffies = p->jiffies;
-			p->jiffies = p->next->jiffies;
-			p->next->jiffies = jiffies;
-			p = p->next;
-		}
+		outb_p(0xc2,0x43);		/* read back count+status, ch 0 */
+		status = inb_p(0x40);
+		count = inb_p(0x40);
+		count |= inb_p(0x40) << 8;
+		if (status & 0x80)		/* OUT high: it has gone off */
+			ticks--;
+		else
+			ticks = (ticks*LATCH - count + LATCH/2) / LATCH;
 	}
-	sti();
+	outb_p(0x36,0x43);		/* binary, mode 3, LSB/MSB, ch 0 */
+	outb_p(LATCH & 0xff , 0x40);
+	outb(LATCH >> 8 , 0x40);
+	jiffies += ticks;
+	task[0]->stime += ticks;
 }
+#endif
 
-void do_timer(long cpl)
+/*
+ * The idle tasks halt the cpu until the next interrupt if there is
+ * nothing to run, or to take from another cpu, letting go of the
+ * kernel lock meanwhile. The sti directly before hlt makes sure an
+ * interrupt coming in between can't be missed. Before that they
+ * clear pages for get_free_page(), one at a time so that a task
+ * woken up meanwhile doesn't have to wait long.
+ */
+void cpu_idle(void)
 {
-	extern int beepcount;
-	extern void sysbeepstop(void);
+	int cpu = smp_processor_id(), depth;
 
-	if (beepcount)
-		if (!--beepcount)
-			sysbeepstop();
+	while (!nr_running(runqueues+cpu) && refill_zero_pool())
+		/* nothing */;
+	cli();
+	if (!nr_running(runqueues+cpu) && !steal_task(cpu,1)) {
+#ifdef TICKLESS
+		if (!cpu)
+			stop_tick();
+		else
+			stop_local_tick(cpu);
+#endif
+		depth = release_kernel_lock();
+		__asm__("sti ; hlt");
+		cli();
+		reacquire_kernel_lock(depth);
+#ifdef TICKLESS
+		if (!cpu)
+			restart_tick(0);
+		else
+			restart_local_tick(cpu);
+#endif
+	}
+	sti();
+}
 
+/*
+ * The tick of a cpu: time accounting and time slices for its current
+ * task. The boot cpu gets it from do_timer(), the others from their
+ * local APIC timers.
+ */
+void do_local_timer(long cpl)
+{
 	if (cpl)
 		current->utime++;
 	else
 		current->stime++;
-
-	if (next_timer) {
-		next_timer->jiffies--;
-		while (next_timer && next_timer->jiffies <= 0) {
-			void (*fn)(void);
-			
-			fn = next_timer->fn;
-			next_timer->fn = NULL;
-			next_timer = next_timer->next;
-			(fn)();
-		}
-	}
-	if (current_DOR & 0xf0)
-		do_floppy_timer();
 	if ((--current->counter)>0) return;
 	current->counter=0;
 	if (!cpl) return;
 	schedule();
 }
 
+void do_timer(long cpl)
+{
+	extern void sysbeepstop(void);
+
+#ifdef TICKLESS
+	if (tick_stopped)
+		restart_tick(1);
+#endif
+
+	if (beepcount)
+		if (!--beepcount)
+			sysbeepstop();
+
+	run_timers();
+	if (current_DOR & 0xf0)
+		do_floppy_timer();
+	do_local_timer(cpl);
+}
+
 int sys_alarm(long seconds)
 {
 	int old = current->alarm;
 
 	if (old)
 		old = (old - jiffies) / HZ;
-	current->alarm = (seconds>0)?(jiffies+HZ*seconds):0;
+	set_alarm(current,(seconds>0)?(jiffies+HZ*seconds):0);
 	return (old);
 }
 
+/*
+ * The statistics change with the run queues, so they are copied the way
+ * the run queues are looked at (see steal_task()): holding the kernel
+ * lock, which keeps the other cpus out, with interrupts off here.
+ */
+int sys_schedstat(int pid, struct schedstat * buf)
+{
+	struct task_struct * p;
+	struct schedstat tmp;
+	unsigned long flags;
+	int i;
+
+	if (!buf)
+		return -EINVAL;
+	lock_kernel();
+	save_flags(flags);
+	cli();
+	if (!pid)
+		tmp = sched_stats;
+	else if (p = find_task_by_pid(pid))
+		tmp = p->sched_stat;
+	else {
+		restore_flags(flags);
+		unlock_kernel();
+		return -ESRCH;
+	}
+	restore_flags(flags);
+	unlock_kernel();
+	verify_area(buf,sizeof *buf);
+	for (i=0 ; i<sizeof *buf ; i++)
+		put_fs_byte(((char *) &tmp)[i],i+(char *) buf);
+	return 0;
+}
+
 int sys_getpid(void)
 {
 	return current->pid;
@@ -468,6 +1194,9 @@ void sched_init(void)
 
 	if (sizeof(struct sigaction) != 16)
 		panic("Struct sigaction MUST be 16 bytes");
+	if (sizeof(struct i387_fxsave_struct) != 512)
+		panic("Struct i387_fxsave_struct MUST be 512 bytes");
+	fpu_init();
 	// 设置初始任务（任务 0）的任务状态段描述符和局部数据表描述符
 	set_tss_desc(gdt+FIRST_TSS_ENTRY,&(init_task.task.tss));
 	set_ldt_desc(gdt+FIRST_LDT_ENTRY,&(init_task.task.ldt));
@@ -480,6 +1209,15 @@ void sched_init(void)
 		p->a=p->b=0;
 		p++;
 	}
+	if (max_tasks > NR_TASKS)
+		max_tasks = NR_TASKS;
+	for (i=0 ; i<NR_CPUS ; i++) {
+		runqueues[i].active = runqueues[i].arrays;
+		runqueues[i].expired = runqueues[i].arrays+1;
+	}
+	for (i=max_tasks-1 ; i>0 ; i--)
+		put_task_slot(i);
+	init_task.task.next_task = init_task.task.prev_task = &init_task.task;
 /* Clear NT, so that we won't have troubles with that later on */
 	__asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl");
 	ltr(0);
@@ -0,0 +1,409 @@
+/*
+ *  linux/kernel/smp.c
+ */
+
+/*
+ * Starting the other cpus, and the kernel lock.
+ *
+ * The cpus are found in the MP configuration table of the bios. The
+ * others are started with the INIT/STARTUP sequence of the local APIC
+ * in the real-mode code of boot/head.s, which takes them to paging and
+ * start_secondary(), on the stack of their idle task. The idle task of
+ * cpu 0 is task 0; the others aren't in task[], have nr 0 (they use
+ * the ldt of task 0) and never leave the kernel. The tss of an idle
+ * task is the tss of its cpu, in the gdt entry of TSS n for cpu n.
+ *
+ * The kernel lock is taken on every entry to the kernel, and dropped
+ * on the way back to user mode, so only one cpu at a time is in the
+ * kernel and cli()/sti() still protect what they always did. A cpu
+ * keeps it across task switches: the depth of the task switched out
+ * is saved in task->lock_depth. The idle tasks drop it while halted.
+ *
+ * Interrupts from the 8259s only go to the boot cpu, which keeps the
+ * time. The others get a tick of their own from the local APIC timer,
+ * for time slices. A cpu that queues a task for an idle one sends it a
+ * reschedule interrupt, which does nothing but wake it from hlt.
+ */
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/head.h>
+#include <linux/smp.h>
+#include <asm/system.h>
+
+extern void apic_timer_interrupt(void);
+extern void apic_spurious_interrupt(void);
+extern void apic_reschedule_interrupt(void);
+extern char trampoline[];
+
+int smp_num_cpus = 1;
+
+static unsigned long apic_phys = 0;
+static int nr_apics = 0;
+static int apic_ids[NR_CPUS];
+static int cpu_apic[NR_CPUS];		/* apic id of each running cpu */
+static long apic_ticks;			/* timer count for one tick */
+
+/* for boot/head.s */
+long ap_stack;
+unsigned long smp_cr0, smp_cr4;
+
+static volatile int cpu_started = 0;
+static volatile int smp_commenced = 0;
+static int booting_cpu;
+
+/*
+ * The MP floating pointer, the configuration table header, and its
+ * processor entries, as in the MultiProcessor Specification 1.4.
+ */
+struct mpf_struct {
+	char signature[4];		/* "_MP_" */
+	unsigned long physptr;
+	unsigned char length,rev,checksum,feature1;
+	unsigned char feature[4];
+};
+
+struct mpc_table {
+	char signature[4];		/* "PCMP" */
+	unsigned short length;
+	unsigned char rev,checksum;
+	char oem[8],product[12];
+	unsigned long oemptr;
+	unsigned short oemsize,count;
+	unsigned long lapic;
+	unsigned short extlen;
+	unsigned char extchecksum,reserved;
+};
+
+struct mpc_cpu {
+	unsigned char type,apicid,apicver,flags;
+	unsigned long signature,features,reserved[2];
+};
+
+#define MP_PROCESSOR	0
+#define CPU_ENABLED	1
+#define CPU_BOOTPROC	2
+
+static int mp_signature(char * p, char * sig)
+{
+	int i;
+
+	for (i = 0 ; i < 4 ; i++)
+		if (p[i] != sig[i])
+			return 0;
+	return 1;
+}
+
+static int mp_checksum(unsigned char * p, int len)
+{
+	unsigned char sum = 0;
+
+	while (len--)
+		sum += *p++;
+	return sum;
+}
+
+static struct mpf_struct * find_mpf(unsigned long base, unsigned long len)
+{
+	struct mpf_struct * mpf = (struct mpf_struct *) base;
+
+	for ( ; len >= 16 ; mpf++, len -= 16)
+		if (mp_signature(mpf->signature,"_MP_") && mpf->length == 1 &&
+		    !mp_checksum((unsigned char *) mpf,16))
+			return mpf;
+	return NULL;
+}
+
+/*
+ * The bios data area isn't there any more (the kernel is), so we look
+ * where the bios usually puts it: the last kB of base memory, and the
+ * bios rom. Only a real table will do, not the default configurations.
+ */
+static struct mpc_table * find_mp_table(void)
+{
+	struct mpf_struct * mpf;
+	struct mpc_table * mpc;
+
+	if (!(mpf = find_mpf(0x9fc00,0x400)) &&
+	    !(mpf = find_mpf(0xf0000,0x10000)))
+		return NULL;
+	if (mpf->feature1 || !mpf->physptr)
+		return NULL;
+	mpc = (struct mpc_table *) mpf->physptr;
+	if (!mp_signature(mpc->signature,"PCMP") ||
+	    mp_checksum((unsigned char *) mpc,mpc->length))
+		return NULL;
+	return mpc;
+}
+
+/*
+ * Called from main() before the buffer cache is set up, which may use
+ * the memory the table is in. Finds the cpus, the boot cpu first, and
+ * maps the local APIC.
+ */
+void smp_init(void)
+{
+	struct mpc_table * mpc;
+	unsigned char * p;
+	struct mpc_cpu * m;
+	unsigned long * pg_table;
+	int i;
+
+	if (!(mpc = find_mp_table()))
+		return;
+	p = (unsigned char *) (mpc+1);
+	for (i = 0 ; i < mpc->count ; i++) {
+		if (*p != MP_PROCESSOR) {
+			p += 8;
+			continue;
+		}
+		m = (struct mpc_cpu *) p;
+		p += sizeof(struct mpc_cpu);
+		if (!(m->flags & CPU_ENABLED))
+			continue;
+		if (m->flags & CPU_BOOTPROC) {
+			if (nr_apics == NR_CPUS)
+				nr_apics--;
+			apic_ids[nr_apics++] = apic_ids[0];
+			apic_ids[0] = m->apicid;
+		} else if (nr_apics < NR_CPUS)
+			apic_ids[nr_apics++] = m->apicid;
+	}
+	if (nr_apics < 2 || !(pg_table = (unsigned long *) get_free_page()))
+		return;
+	apic_phys = mpc->lapic;
+	pg_table[(APIC_BASE>>12) & 0x3ff] = apic_phys | 0x1b;	/* PCD, PWT */
+	pg_dir[APIC_BASE>>22] = (unsigned long) pg_table | 3;
+	__asm__("movl %%eax,%%cr3"::"a" (0));
+	printk("MP table: %d cpus, local APIC at %p\n\r",nr_apics,apic_phys);
+}
+
+static void wait_ticks(long n)
+{
+	long t = jiffies + n;
+
+	while (jiffies < t)
+		/* nothing */;
+}
+
+/*
+ * Counts how far the local APIC timer (divided by 16) gets in a tick
+ * of the PIT. All the cpus are assumed to run their timers at the
+ * same rate.
+ */
+static void calibrate_apic_timer(void)
+{
+	apic_write(APIC_TDCR,0x3);
+	apic_write(APIC_LVTT,0x10000);		/* masked, one-shot */
+	wait_ticks(1);
+	apic_write(APIC_TMICT,0xffffffff);
+	wait_ticks(1);
+	apic_ticks = 0xffffffff - apic_read(APIC_TMCCT);
+	apic_write(APIC_TMICT,0);
+}
+
+static void send_ipi(int apicid, unsigned long cmd)
+{
+	apic_write(APIC_ICR2,apicid<<24);
+	apic_write(APIC_ICR,cmd);
+	while (apic_read(APIC_ICR) & 0x1000)	/* delivery pending */
+		/* nothing */;
+}
+
+/*
+ * Called from main() with interrupts enabled (we time things with the
+ * tick), before task 0 goes to user mode. The cpus that start get the
+ * numbers 1, 2 etc in the order of the table.
+ */
+void smp_boot(void)
+{
+	struct task_struct * idle;
+	int i, cpu;
+
+	if (!apic_phys)
+		return;
+	set_intr_gate(LOCAL_TIMER_VECTOR,&apic_timer_interrupt);
+	set_intr_gate(SPURIOUS_VECTOR,&apic_spurious_interrupt);
+	set_intr_gate(RESCHEDULE_VECTOR,&apic_reschedule_interrupt);
+	apic_write(APIC_SVR,apic_read(APIC_SVR) | 0x100 | SPURIOUS_VECTOR);
+	calibrate_apic_timer();
+	cpu_apic[0] = apic_ids[0];
+	__asm__("movl %%cr0,%0":"=r" (smp_cr0));
+	__asm__(".byte 0x0f,0x20,0xe0":"=a" (smp_cr4));	/* movl %cr4,%eax */
+	for (i = 1 ; i < nr_apics ; i++) {
+		cpu = smp_num_cpus;
+		if (!(idle = (struct task_struct *) get_free_page()))
+			break;
+		*idle = *task[0];
+		memset(&idle->sched_stat,0,sizeof(idle->sched_stat));
+		idle->tss.esp0 = PAGE_SIZE + (long) idle;
+		idle->cpu = cpu;
+		idle->i387 = NULL;
+		idle->utime = idle->stime = 0;
+		idle_set[cpu] = current_set[cpu] = idle;
+		set_tss_desc(gdt+(cpu<<1)+FIRST_TSS_ENTRY,&(idle->tss));
+		ap_stack = PAGE_SIZE + (long) idle;
+		booting_cpu = cpu;
+		cpu_started = 0;
+		send_ipi(apic_ids[i],0x4500);		/* INIT */
+		wait_ticks(2);
+		send_ipi(apic_ids[i],0x4600 | ((long) trampoline >> 12));
+		wait_ticks(1);
+		if (!cpu_started)			/* STARTUP, again */
+			send_ipi(apic_ids[i],0x4600 | ((long) trampoline >> 12));
+		wait_ticks(HZ/10+1);
+		if (!cpu_started) {
+			printk("APIC %d didn't start\n\r",apic_ids[i]);
+			idle_set[cpu] = current_set[cpu] = NULL;
+			free_page((long) idle);
+			continue;
+		}
+		cpu_apic[cpu] = apic_ids[i];
+		smp_num_cpus++;
+	}
+	printk("%d cpus running\n\r",smp_num_cpus);
+	smp_commenced = 1;
+}
+
+/*
+ * The other cpus come here from boot/head.s, with paging on and
+ * interrupts disabled, and become the idle task of their cpu.
+ */
+void start_secondary(void)
+{
+	int cpu = booting_cpu;
+
+	ltr(cpu);
+	lldt(0);
+	apic_write(APIC_SVR,apic_read(APIC_SVR) | 0x100 | SPURIOUS_VECTOR);
+	apic_write(APIC_TPR,0);
+	apic_write(APIC_TDCR,0x3);
+	apic_write(APIC_LVTT,0x20000 | LOCAL_TIMER_VECTOR);	/* periodic */
+	apic_write(APIC_TMICT,apic_ticks);
+	cpu_started = 1;
+	while (!smp_commenced)
+		/* nothing */;
+	lock_kernel();
+	for (;;) {
+		cpu_idle();
+		schedule();
+	}
+}
+
+/*
+ * Called with interrupts disabled.
+ */
+void smp_send_reschedule(int cpu)
+{
+	if (cpu != smp_processor_id())
+		send_ipi(cpu_apic[cpu],0x4000 | RESCHEDULE_VECTOR);
+}
+
+#ifdef TICKLESS
+/*
+ * Tickless idle for the other cpus. Their idle task has no timers to
+ * wait for, and is sent a reschedule interrupt when there is work (see
+ * kick_idle_cpu() in kernel/sched.c), so the local APIC timer is put
+ * in one-shot mode for a second, just in case. As for the PIT on cpu
+ * 0, the ticks that passed are worked out from the current count when
+ * the cpu wakes up. If the one-shot has gone off (the count stays at
+ * 0), its interrupt counts the last tick itself.
+ */
+static unsigned long local_stopped[NR_CPUS];	/* 0 if periodic */
+
+void stop_local_tick(int cpu)
+{
+	apic_write(APIC_LVTT,LOCAL_TIMER_VECTOR);		/* one-shot */
+	apic_write(APIC_TMICT,HZ*apic_ticks);
+	local_stopped[cpu] = HZ;
+}
+
+void restart_local_tick(int cpu)
+{
+	unsigned long ticks = local_stopped[cpu], count;
+
+	if (!ticks)
+		return;
+	local_stopped[cpu] = 0;
+	if (!(count = apic_read(APIC_TMCCT)))
+		ticks--;
+	else
+		ticks = (ticks*apic_ticks - count + apic_ticks/2) / apic_ticks;
+	apic_write(APIC_LVTT,0x20000 | LOCAL_TIMER_VECTOR);	/* periodic */
+	apic_write(APIC_TMICT,apic_ticks);
+	idle_set[cpu]->stime += ticks;
+}
+#endif
+
+/*
+ * A process running on another cpu may have its pages in the TLB
+ * there, so the page tables of such a process must not be changed
+ * (we have no TLB shootdown). The others flushed theirs when they
+ * last loaded cr3.
+ */
+int running_elsewhere(struct task_struct * p)
+{
+	int cpu;
+
+	for (cpu = 0 ; cpu < smp_num_cpus ; cpu++)
+		if (cpu != smp_processor_id() && current_set[cpu] == p)
+			return 1;
+	return 0;
+}
+
+/*
+ * The kernel lock. kernel_owner is only set to a cpu by that cpu, so
+ * it can look at it without the lock.
+ */
+static volatile int kernel_flag = 0;
+static volatile int kernel_owner = -1;
+int kernel_depth = 0;
+
+void lock_kernel(void)
+{
+	int cpu = smp_processor_id(), busy;
+
+	if (kernel_owner == cpu) {
+		kernel_depth++;
+		return;
+	}
+	for (;;) {
+		__asm__ __volatile__("xchgl %0,%1"
+			:"=r" (busy),"=m" (kernel_flag)
+			:"0" (1):"memory");
+		if (!busy)
+			break;
+		while (kernel_flag)
+			__asm__("rep ; nop");		/* pause */
+	}
+	kernel_owner = cpu;
+	kernel_depth = 1;
+}
+
+void unlock_kernel(void)
+{
+	if (--kernel_depth)
+		return;
+	kernel_owner = -1;
+	__asm__ __volatile__("movl $0,%0":"=m" (kernel_flag)::"memory");
+}
+
+/*
+ * For the idle tasks: let go of the lock whatever the depth, and get
+ * it back again.
+ */
+int release_kernel_lock(void)
+{
+	int depth = kernel_depth;
+
+	kernel_depth = 1;
+	unlock_kernel();
+	return depth;
+}
+
+void reacquire_kernel_lock(int depth)
+{
+	lock_kernel();
+	kernel_depth = depth;
+}
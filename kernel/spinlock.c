@@ -0,0 +1,100 @@
+/*
+ *  linux/kernel/spinlock.c
+ */
+
+/*
+ * The spin locks, and lockstat(). The hold time of a lock is the time
+ * stamp counter from spin_lock() to spin_unlock(): only the low half
+ * is read, which is plenty for anything that is held while spinning.
+ */
+#include <errno.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+
+extern spinlock_t io_request_lock, buffer_lock, inode_lock;
+extern spinlock_t page_alloc_lock;
+
+/* the locks lockstat() knows about */
+static spinlock_t * lock_table[] = {
+	&io_request_lock, &buffer_lock, &inode_lock, &page_alloc_lock };
+
+#define NR_LOCKS (sizeof(lock_table)/sizeof(spinlock_t *))
+
+static int has_tsc = 0;
+
+#define rdtsc() ({ \
+unsigned long __t; \
+__asm__ __volatile__(".byte 0x0f,0x31":"=a" (__t)::"dx"); \
+__t; })
+
+void spin_lock(spinlock_t * lock)
+{
+	long spins = 0;
+	int busy;
+
+	for (;;) {
+		__asm__ __volatile__("xchgl %0,%1"
+			:"=r" (busy),"=m" (lock->lock)
+			:"0" (1):"memory");
+		if (!busy)
+			break;
+		if (!spins++)
+			lock->stat.ls_contended++;
+		while (lock->lock) {
+			spins++;
+			__asm__("rep ; nop");		/* pause */
+		}
+	}
+	lock->stat.ls_acquired++;
+	lock->stat.ls_spins += spins;
+	if (has_tsc)
+		lock->start = rdtsc();
+}
+
+void spin_unlock(spinlock_t * lock)
+{
+	unsigned long t;
+
+	if (!lock->lock)
+		printk("spin_unlock: %s not locked\n\r",lock->stat.ls_name);
+	if (has_tsc) {
+		t = rdtsc() - lock->start;
+		lock->stat.ls_hold_total += t;
+		if (t > lock->stat.ls_hold_max)
+			lock->stat.ls_hold_max = t;
+	}
+	__asm__ __volatile__("movl $0,%0":"=m" (lock->lock)::"memory");
+}
+
+/*
+ * Called from main(): the hold times are only kept if the cpu has a
+ * time stamp counter.
+ */
+void lockstat_init(void)
+{
+	if (cpu_features() & 0x10)
+		has_tsc = 1;
+}
+
+int sys_lockstat(int n, struct lockstat * buf)
+{
+	struct lockstat tmp;
+	unsigned long flags;
+	int i;
+
+	if (n < 0 || n >= NR_LOCKS)
+		return -EINVAL;
+	if (!buf)
+		return -EINVAL;
+	spin_lock_irqsave(lock_table[n],flags);
+	tmp = lock_table[n]->stat;
+	spin_unlock_irqrestore(lock_table[n],flags);
+	verify_area(buf,sizeof *buf);
+	for (i=0 ; i<sizeof *buf ; i++)
+		put_fs_byte(((char *) &tmp)[i],i+(char *) buf);
+	return 0;
+}
@@ -14,6 +14,10 @@
  * don't handle signal-recognition, as that would clutter them up totally
  * unnecessarily.
  *
+ * Every way into the kernel takes the kernel lock (see kernel/smp.c),
+ * and lets go of it on the way out: ret_from_sys_call does that for
+ * those that go through it.
+ *
  * Stack layout in 'ret_from_system_call':
  *
  *	 0(%esp) - %eax
@@ -58,15 +62,20 @@ sa_mask = 4
 sa_flags = 8
 sa_restorer = 12
 
-nr_system_calls = 72
+nr_system_calls = 80
+
+first_tss = 0x20	# _TSS(0), see linux/sched.h
+apic_eoi = 0xfee000b0	# APIC_BASE+APIC_EOI, see linux/smp.h
 
 /*
  * Ok, I get parallel printer interrupts while using the floppy for some
  * strange reason. Urgel. Now I just ignore them.
  */
 .globl _system_call,_sys_fork,_timer_interrupt,_sys_execve
-.globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt
+.globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt,_ret_from_fork
 .globl _device_not_available, _coprocessor_error
+.globl _apic_timer_interrupt,_apic_spurious_interrupt
+.globl _apic_reschedule_interrupt
 
 .align 2
 bad_sys_call:
@@ -91,16 +100,25 @@ _system_call:
 	mov %dx,%es
 	movl $0x17,%edx		# fs points to local data space
 	mov %dx,%fs
+	pushl %eax
+	call _lock_kernel
+	popl %eax
 	call _sys_call_table(,%eax,4)
 	pushl %eax
-	movl _current,%eax
+	xorl %eax,%eax			# current: cpu n has loaded
+	str %ax				# TSS n, at first_tss+16*n
+	shrl $2,%eax
+	movl _current_set-(first_tss>>2)(%eax),%eax
 	cmpl $0,state(%eax)		# state
 	jne reschedule
 	cmpl $0,counter(%eax)		# counter
 	je reschedule
 ret_from_sys_call:
-	movl _current,%eax		# task[0] cannot have signals
-	cmpl _task,%eax
+	xorl %eax,%eax			# current, as above
+	str %ax
+	shrl $2,%eax
+	movl _current_set-(first_tss>>2)(%eax),%eax
+	cmpl _task,%eax			# task[0] cannot have signals
 	je 3f
 	cmpw $0x0f,CS(%esp)		# was old code segment supervisor ?
 	jne 3f
@@ -118,7 +136,8 @@ ret_from_sys_call:
 	pushl %ecx
 	call _do_signal
 	popl %eax
-3:	popl %eax
+3:	call _unlock_kernel
+	popl %eax
 	popl %ebx
 	popl %ecx
 	popl %edx
@@ -141,6 +160,7 @@ _coprocessor_error:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	pushl $ret_from_sys_call
 	jmp _math_error
 
@@ -158,6 +178,7 @@ _device_not_available:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	pushl $ret_from_sys_call
 	clts				# clear TS so that we can use math
 	movl %cr0,%eax
@@ -189,6 +210,7 @@ _timer_interrupt:
 	incl _jiffies
 	movb $0x20,%al		# EOI to interrupt controller #1
 	outb %al,$0x20
+	call _lock_kernel
 	movl CS(%esp),%eax
 	andl $3,%eax		# %eax is CPL (0 or 3, 0=supervisor)
 	pushl %eax
@@ -196,6 +218,51 @@ _timer_interrupt:
 	addl $4,%esp		# task switching to accounting ...
 	jmp ret_from_sys_call
 
+/*
+ * The tick of the other cpus, from their local APIC timers.
+ */
+.align 2
+_apic_timer_interrupt:
+	push %ds
+	push %es
+	push %fs
+	pushl %edx
+	pushl %ecx
+	pushl %ebx
+	pushl %eax
+	movl $0x10,%eax
+	mov %ax,%ds
+	mov %ax,%es
+	movl $0x17,%eax
+	mov %ax,%fs
+	movl $0,apic_eoi	# EOI to the local APIC
+	call _lock_kernel
+	movl CS(%esp),%eax
+	andl $3,%eax
+	pushl %eax
+	call _do_local_timer
+	addl $4,%esp
+	jmp ret_from_sys_call
+
+.align 2
+_apic_spurious_interrupt:
+	iret
+
+/*
+ * Sent by another cpu that has queued a task for this one: waking up
+ * from hlt is all it is for.
+ */
+.align 2
+_apic_reschedule_interrupt:
+	push %ds
+	pushl %eax
+	movl $0x10,%eax
+	mov %ax,%ds
+	movl $0,apic_eoi	# EOI to the local APIC
+	popl %eax
+	pop %ds
+	iret
+
 .align 2
 _sys_execve:
 	lea EIP(%esp),%eax
@@ -204,6 +271,21 @@ _sys_execve:
 	addl $4,%esp
 	ret
 
+/*
+ * A new task starts here, when switch_to() first switches to it: the
+ * registers saved in its switch frame are the user ones, and below it
+ * is the frame of the fork system call (see copy_process()).
+ */
+.align 2
+_ret_from_fork:
+	popl %ebx
+	popl %esi
+	popl %edi
+	popl %ebp
+	pop %gs
+	pop %fs
+	jmp ret_from_sys_call
+
 .align 2
 _sys_fork:
 	call _find_empty_process
@@ -230,6 +312,7 @@ _hd_interrupt:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	movb $0x20,%al
 	outb %al,$0xA0		# EOI to interrupt controller #1
 	jmp 1f			# give port chance to breathe
@@ -241,6 +324,7 @@ _hd_interrupt:
 	movl $_unexpected_hd_interrupt,%edx
 1:	outb %al,$0x20
 	call *%edx		# "interesting" way of handling intr.
+	call _unlock_kernel
 	pop %fs
 	pop %es
 	pop %ds
@@ -261,6 +345,7 @@ _floppy_interrupt:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	movb $0x20,%al
 	outb %al,$0x20		# EOI to interrupt controller #1
 	xorl %eax,%eax
@@ -269,6 +354,7 @@ _floppy_interrupt:
 	jne 1f
 	movl $_unexpected_floppy_interrupt,%eax
 1:	call *%eax		# "interesting" way of handling intr.
+	call _unlock_kernel
 	pop %fs
 	pop %es
 	pop %ds
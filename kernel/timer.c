@@ -0,0 +1,190 @@
+/*
+ *  linux/kernel/timer.c
+ */
+
+/*
+ * The kernel timers, kept on a timer wheel: a timer due within the
+ * next 256 ticks is on the list for its tick in tv1, one due later on
+ * the list for its 256-tick (64*256-tick etc) period in tv2..tv5. Each
+ * time the low bits of timer_jiffies wrap around, the next list of the
+ * level above is spread out over the levels below it. Adding and
+ * removing a timer is thus constant time, and each timer is moved at
+ * most 4 times before it runs.
+ */
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/timer.h>
+#include <asm/system.h>
+
+#define TVN_BITS 6
+#define TVR_BITS 8
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVR_MASK (TVR_SIZE - 1)
+
+static struct timer_list * tv1[TVR_SIZE];
+static struct timer_list * tvn[4][TVN_SIZE];
+
+/* all ticks before this have been handled */
+static long timer_jiffies = 0;
+
+static void internal_add_timer(struct timer_list * timer)
+{
+	long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+	struct timer_list ** list;
+
+	if ((long) idx < 0)
+		list = tv1 + (timer_jiffies & TVR_MASK);
+	else if (idx < TVR_SIZE)
+		list = tv1 + (expires & TVR_MASK);
+	else if (idx < 1 << (TVR_BITS + TVN_BITS))
+		list = tvn[0] + ((expires >> TVR_BITS) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 2*TVN_BITS))
+		list = tvn[1] + ((expires >> (TVR_BITS+TVN_BITS)) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 3*TVN_BITS))
+		list = tvn[2] + ((expires >> (TVR_BITS+2*TVN_BITS)) & TVN_MASK);
+	else
+		list = tvn[3] + ((expires >> (TVR_BITS+3*TVN_BITS)) & TVN_MASK);
+	if (timer->next = *list)
+		(*list)->pprev = &timer->next;
+	*list = timer;
+	timer->pprev = list;
+}
+
+static void detach_timer(struct timer_list * timer)
+{
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	*timer->pprev = timer->next;
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+void add_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (timer_pending(timer))
+		printk("add_timer: timer already pending\n\r");
+	else
+		internal_add_timer(timer);
+	restore_flags(flags);
+}
+
+int del_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	save_flags(flags);
+	cli();
+	if (timer_pending(timer)) {
+		detach_timer(timer);
+		ret = 1;
+	}
+	restore_flags(flags);
+	return ret;
+}
+
+void mod_timer(struct timer_list * timer, long expires)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (timer_pending(timer))
+		detach_timer(timer);
+	timer->expires = expires;
+	internal_add_timer(timer);
+	restore_flags(flags);
+}
+
+/*
+ * Spread the timers of one list of a higher level over the levels
+ * below it, now that they are due within its period.
+ */
+static void cascade(struct timer_list ** list)
+{
+	struct timer_list * timer, * next;
+
+	timer = *list;
+	*list = NULL;
+	for ( ; timer ; timer = next) {
+		next = timer->next;
+		timer->next = NULL;
+		timer->pprev = NULL;
+		internal_add_timer(timer);
+	}
+}
+
+/*
+ * Called from do_timer() with interrupts disabled. A timer function
+ * may add (or delete) timers itself.
+ */
+void run_timers(void)
+{
+	struct timer_list * timer;
+	int n, idx;
+
+	while (jiffies - timer_jiffies >= 0) {
+		if (!(timer_jiffies & TVR_MASK))
+			for (n = 0 ; n < 4 ; n++) {
+				idx = (timer_jiffies >> (TVR_BITS + n*TVN_BITS))
+					& TVN_MASK;
+				cascade(tvn[n] + idx);
+				if (idx)
+					break;
+			}
+		while (timer = tv1[timer_jiffies & TVR_MASK]) {
+			detach_timer(timer);
+			(timer->function)(timer->data);
+		}
+		timer_jiffies++;
+	}
+}
+
+#ifdef TICKLESS
+/*
+ * How many ticks from now until run_timers() has work to do (a timer
+ * to run or a list to cascade), at most 'max'. The idle task doesn't
+ * need the tick before then.
+ */
+long next_timer_ticks(long max)
+{
+	long t;
+
+	for (t = timer_jiffies ; t - jiffies < max ; t++)
+		if (!(t & TVR_MASK) || tv1[t & TVR_MASK])
+			break;
+	return t - jiffies;
+}
+#endif
+
+static void process_timeout(unsigned long data)
+{
+	wake_up_process((struct task_struct *) data);
+}
+
+/*
+ * Sleep for at most 'timeout' ticks, in whatever state the caller has
+ * set, unless woken up earlier. Returns the number of ticks left.
+ */
+long schedule_timeout(long timeout)
+{
+	struct timer_list timer;
+	long expires = jiffies + timeout;
+
+	init_timer(&timer);
+	timer.expires = expires;
+	timer.function = process_timeout;
+	timer.data = (unsigned long) current;
+	add_timer(&timer);
+	schedule();
+	del_timer(&timer);
+	timeout = expires - jiffies;
+	return (timeout < 0) ? 0 : timeout;
+}
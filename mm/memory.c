@@ -27,8 +27,11 @@
  */
 
 #include <signal.h>
+#include <errno.h>
 
 #include <asm/system.h>
+#include <asm/segment.h>
+#include <sys/memstat.h>
 
 #include <linux/sched.h>
 #include <linux/head.h>
@@ -42,17 +45,9 @@ static inline volatile void oom(void)
 	do_exit(SIGSEGV);
 }
 
-// 通过重置CR3为0，刷新“页变换高速缓存”
+/* the page directory entry for address, in the directory of current */
+#define dir_entry(address) (page_dir(current) + ((address)>>22))
 
-#define invalidate() \
-__asm__("movl %%eax,%%cr3"::"a" (0))
-
-/* these are not to be changed without changing head.s etc */
-
-#define LOW_MEM 0x100000                      // 1M，1M以内的内存是内核专用的
-#define PAGING_MEMORY (15*1024*1024)          // 16M
-#define PAGING_PAGES (PAGING_MEMORY>>12)      // >>12即除以4K算出有多少个页
-#define MAP_NR(addr) (((addr)-LOW_MEM)>>12)   // 计算页的编号
 #define USED 100                              // 页面占用标志
 
 // 判断地址是否在当前的代码段中
@@ -60,7 +55,8 @@ __asm__("movl %%eax,%%cr3"::"a" (0))
 #define CODE_SPACE(addr) ((((addr)+4095)&~4095) < \
 current->start_code + current->end_code)
 
-static long HIGH_MEMORY = 0;                  // 存放实际物理内存的最高端地址
+long HIGH_MEMORY = 0;                         // 存放实际物理内存的最高端地址
+static unsigned long paging_pages = 0;        /* pages from LOW_MEM up */
 
 // 复制一页内存
 
@@ -71,47 +67,238 @@ __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024):"cx","di","si")
  *主内存区中所有物理内存页的状态。每个字节描述一个物理内存页的占用状态。
  *其中的值表示被占用的次数，0 表示对应的物理内存空闲着。当申请一页物理
  *内存时，就将对应字节的值增 1。
+ *
+ * mem_map[] and free_order[] have paging_pages entries each, and are
+ * put at the start of main memory by mem_init(), as their size depends
+ * on how much memory there is.
+ */
+
+unsigned char * mem_map = NULL;
+
+/*
+ * The free pages are kept by the buddy system: a free block of 2^order
+ * pages, starting at a page number that is a multiple of 2^order, is
+ * on free_area[order], linked through its first page (the pages are
+ * free, so nobody minds). free_order[] is order+1 for the first page of
+ * a free block, 0 for all other pages. When a block is freed and its
+ * buddy (the other half of the block of twice the size) is free as
+ * well, the two are merged, and so on up. Allocating takes a block of
+ * the smallest order there is, splitting off and freeing the halves it
+ * doesn't need.
+ *
+ * Page numbers count from LOW_MEM, which is aligned to 1MB, so a block
+ * is aligned to its size in physical memory as well: one of at most
+ * 64kB never crosses a 64kB boundary, as ISA DMA wants. Every page of
+ * an allocated block gets a count of 1 in mem_map[], and is given back
+ * with free_page() like any other, which is how shared pages still
+ * work: only the free lists are new.
+ */
+struct mem_list {
+	struct mem_list * next;
+	struct mem_list * prev;
+};
+
+static struct mem_list free_area[NR_MEM_LISTS];
+static unsigned char * free_order = NULL;
+struct memstat mem_stats;	/* mm/swap.c keeps its own counters here */
+
+/*
+ * Pages that have already been cleared, for get_free_page() to hand
+ * out without clearing them first. The idle tasks fill the pool up
+ * (see refill_zero_pool()), as long as that leaves ZERO_POOL_MIN free
+ * pages: it is given back when memory gets short.
+ */
+#define ZERO_POOL	32
+#define ZERO_POOL_MIN	(4*ZERO_POOL)
+
+static unsigned long zero_pool[ZERO_POOL];
+static int nr_zero_pages = 0;
+
+spinlock_t page_alloc_lock = SPIN_LOCK_UNLOCKED("page_alloc");
+
+#define PAGE_OF(nr) ((struct mem_list *) (LOW_MEM + ((nr)<<12)))
+
+static inline void add_mem_queue(unsigned long nr, int order)
+{
+	struct mem_list * head = free_area+order, * entry = PAGE_OF(nr);
+
+	entry->prev = head;
+	entry->next = head->next;
+	head->next->prev = entry;
+	head->next = entry;
+	free_order[nr] = order+1;
+	mem_stats.ms_free_blocks[order]++;
+}
+
+static inline void remove_mem_queue(unsigned long nr, int order)
+{
+	struct mem_list * entry = PAGE_OF(nr);
+
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+	free_order[nr] = 0;
+	mem_stats.ms_free_blocks[order]--;
+}
+
+/*
+ * Give the block of 2^order pages at page nr back to the free lists,
+ * merging it with its buddies. Called with page_alloc_lock held.
+ */
+static void free_pages_ok(unsigned long nr, int order)
+{
+	unsigned long buddy;
+
+	mem_stats.ms_free += 1 << order;
+	while (order < NR_MEM_LISTS-1) {
+		buddy = nr ^ (1 << order);
+		if (buddy >= paging_pages || free_order[buddy] != order+1)
+			break;
+		remove_mem_queue(buddy,order);
+		nr &= ~(1 << order);
+		order++;
+	}
+	add_mem_queue(nr,order);
+}
+
+/*
+ * Get 2^order contiguous pages, each with a count of 1 in mem_map[],
+ * and return the physical address of the first one, or 0 if there
+ * isn't a free block that large. The pages aren't cleared: this is for
+ * callers that fill them completely themselves. The last single pages
+ * are those in the zero pool.
  */
+static unsigned long alloc_pages(int order)
+{
+	unsigned long nr, flags;
+	int i, new_order;
 
-static unsigned char mem_map [ PAGING_PAGES ] = {0,};
+	if (order < 0 || order >= NR_MEM_LISTS)
+		return 0;
+	spin_lock_irqsave(&page_alloc_lock,flags);
+	for (new_order = order ; new_order < NR_MEM_LISTS ; new_order++)
+		if (free_area[new_order].next != free_area+new_order)
+			break;
+	if (new_order >= NR_MEM_LISTS) {
+		if (!order && nr_zero_pages) {
+			nr = zero_pool[--nr_zero_pages];
+			mem_stats.ms_zero_pool--;
+			mem_stats.ms_allocs[0]++;
+			spin_unlock_irqrestore(&page_alloc_lock,flags);
+			return nr;
+		}
+		mem_stats.ms_failed++;
+		spin_unlock_irqrestore(&page_alloc_lock,flags);
+		return 0;
+	}
+	nr = MAP_NR((unsigned long) free_area[new_order].next);
+	remove_mem_queue(nr,new_order);
+/* give back the upper halves we don't need */
+	while (new_order > order) {
+		new_order--;
+		add_mem_queue(nr + (1 << new_order),new_order);
+	}
+	for (i = 0 ; i < (1 << order) ; i++) {
+		if (mem_map[nr+i])
+			panic("free page in use");
+		mem_map[nr+i] = 1;
+	}
+	mem_stats.ms_free -= 1 << order;
+	mem_stats.ms_allocs[order]++;
+	spin_unlock_irqrestore(&page_alloc_lock,flags);
+	return LOW_MEM + (nr << 12);
+}
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * The same, but with swap space (see mm/swap.c) pages are swapped out
+ * first if there are fewer than FREE_PAGES_LOW free, and then as long
+ * as it takes to get the block.
+ */
+#define FREE_PAGES_LOW	32
+
+unsigned long __get_free_pages(int order)
+{
+	unsigned long page;
+	int tries = 0;
+
+	while (mem_stats.ms_free < FREE_PAGES_LOW && swap_out())
+		/* nothing */;
+	while (!(page = alloc_pages(order)) && tries++ < (8 << order) &&
+	    swap_out())
+		/* nothing */;
+	return page;
+}
+
+#define clear_pages(addr,n) \
+__asm__("cld ; rep ; stosl"::"a" (0),"D" (addr),"c" ((n)*1024):"cx","di")
+
+/*
+ * Get physical address of a free page, cleared, and mark it used. If
+ * no free pages left, return 0.
  */
 
 /***************IMPORTANT***********
  * free_page和get_free_page函数是针对物理内存的，与线性地址无关
  */
+unsigned long get_free_page(void)
+{
+	unsigned long page, flags;
+
+	spin_lock_irqsave(&page_alloc_lock,flags);
+	if (nr_zero_pages) {
+		page = zero_pool[--nr_zero_pages];
+		mem_stats.ms_zero_pool--;
+		mem_stats.ms_zero_hits++;
+		mem_stats.ms_allocs[0]++;
+		spin_unlock_irqrestore(&page_alloc_lock,flags);
+		return page;
+	}
+	mem_stats.ms_zero_misses++;
+	spin_unlock_irqrestore(&page_alloc_lock,flags);
+	if (page = __get_free_pages(0))
+		clear_pages(page,1);
+	return page;
+}
 
 /*
- *get_free_page()函数用于在主内存区中申请一页空闲内存页，并返回物理内存页的起始地址。它首先
- *扫描内存页面字节图数组 mem_map[]，寻找值是 0 的字节项（对应空闲页面）。若无则返回 0 结束，表
- *示物理内存已使用完。若找到值为 0 的字节，则将其置 1，并换算出对应空闲页面的起始地址。然后对
- *该内存页面作清零操作。最后返回该空闲页面的物理内存起始地址。
- *注意！！！！：这里只是在主内存区域申请一页空闲内存页，此处还没映射至线性地址，put_page函数完成映射
+ * Called by the idle tasks while they have nothing else to do: clears
+ * one page for the zero pool. Returns 0 when there is nothing more to
+ * be done (the pool is full, or memory is short).
  */
+int refill_zero_pool(void)
+{
+	unsigned long page, flags;
 
-unsigned long get_free_page(void)
+	if (nr_zero_pages >= ZERO_POOL || mem_stats.ms_free <= ZERO_POOL_MIN)
+		return 0;
+	if (!(page = alloc_pages(0)))
+		return 0;
+	clear_pages(page,1);
+	spin_lock_irqsave(&page_alloc_lock,flags);
+	if (nr_zero_pages < ZERO_POOL) {
+		zero_pool[nr_zero_pages++] = page;
+		mem_stats.ms_zero_pool++;
+		mem_stats.ms_zero_refills++;
+		page = 0;
+	}
+	spin_unlock_irqrestore(&page_alloc_lock,flags);
+	if (page) {
+		free_page(page);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * The same for 2^order contiguous pages (for DMA buffers and the like),
+ * to be given back with free_pages().
+ */
+unsigned long get_free_pages(int order)
 {
-register unsigned long __res asm("ax");
-
-__asm__("std ; repne ; scasb\n\t"
-	"jne 1f\n\t"
-	"movb $1,1(%%edi)\n\t"
-	"sall $12,%%ecx\n\t"
-	"addl %2,%%ecx\n\t"
-	"movl %%ecx,%%edx\n\t"
-	"movl $1024,%%ecx\n\t"
-	"leal 4092(%%edx),%%edi\n\t"
-	"rep ; stosl\n\t"
-	"movl %%edx,%%eax\n"
-	"1:"
-	:"=a" (__res)
-	:"0" (0),"i" (LOW_MEM),"c" (PAGING_PAGES),
-	"D" (mem_map+PAGING_PAGES-1)
-	:"di","cx","dx");
-return __res;
+	unsigned long page;
+
+	if (page = __get_free_pages(order))
+		clear_pages(page,1 << order);
+	return page;
 }
 
 
@@ -124,18 +311,50 @@ return __res;
  *free_page()用于释放指定地址处的一页物理内存。它首先判断指定的内存地址是否<1M，若是则返
  *回，因为 1M 以内是内核专用的；若指定的物理内存地址大于或等于实际内存最高端地址，则显示出错
  *信息；然后由指定的内存地址换算出页面号: (addr - 1M)/4K；接着判断页面号对应的 mem_map[]字节项
- *是否为 0，若不为 0，则减 1 返回；否则对该字节项清零，并显示“试图释放一空闲页面”的出错信息。
+ *是否为 0，若不为 0，则减 1，减到 0 时页面回到空闲链表；否则显示“试图释放一空闲页面”的出错信息。
  */
 void free_page(unsigned long addr)
 {
+	unsigned long flags;
+
 	if (addr < LOW_MEM) return;
 	if (addr >= HIGH_MEMORY)
 		panic("trying to free nonexistent page");
 	addr -= LOW_MEM;
 	addr >>= 12;
-	if (mem_map[addr]--) return;
-	mem_map[addr]=0;
-	panic("trying to free free page");
+	spin_lock_irqsave(&page_alloc_lock,flags);
+	if (!mem_map[addr])
+		panic("trying to free free page");
+	if (!--mem_map[addr]) {
+		mem_stats.ms_frees++;
+		free_pages_ok(addr,0);
+	}
+	spin_unlock_irqrestore(&page_alloc_lock,flags);
+}
+
+void free_pages(unsigned long addr, int order)
+{
+	int i;
+
+	for (i = 0 ; i < (1 << order) ; i++, addr += PAGE_SIZE)
+		free_page(addr);
+}
+
+int sys_memstat(struct memstat * buf)
+{
+	struct memstat tmp;
+	unsigned long flags;
+	int i;
+
+	if (!buf)
+		return -EINVAL;
+	spin_lock_irqsave(&page_alloc_lock,flags);
+	tmp = mem_stats;
+	spin_unlock_irqrestore(&page_alloc_lock,flags);
+	verify_area(buf,sizeof *buf);
+	for (i=0 ; i<sizeof *buf ; i++)
+		put_fs_byte(((char *) &tmp)[i],i+(char *) buf);
+	return 0;
 }
 
 /*
@@ -152,11 +371,11 @@ void free_page(unsigned long addr)
  *换高速缓冲。
  */
 
-int free_page_tables(unsigned long from,unsigned long size)
+int free_page_tables(unsigned long * dir,unsigned long from,unsigned long size)
 {
 	// Linus真的太牛了，这里一开始定义为unsigned long *类型的指针，则后面++一次增加4个字节
 	unsigned long *pg_table;
-	unsigned long * dir, nr;
+	unsigned long nr;
 
 	if (from & 0x3fffff)
 		panic("free_page_tables called with wrong alignment");
@@ -169,13 +388,7 @@ int free_page_tables(unsigned long from,unsigned long size)
      *例如，如果原size=4.01Mb，那么可得到结果sieze=2
 	 */
 	size = (size + 0x3fffff) >> 22;
-	/*
-	 *计算给出的线性基地址对应的真实目录项地址。对应的目录项号＝from>>22.因为每
-     *项占4字节，并且由于页目录表从物理地址0开始存放，因此实际目录项指针＝目录
-     *项号<<2，也即(from>>20)。& 0xffc确保目录项指针范围有效，即用于屏蔽目录项
-     *指针最后2位。因为只移动了20位，因此最后2位是页表项索引的内容，应屏蔽掉。
-	 */
-	dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
+	dir += from>>22;
 	// --> !!!!哈皮了这里，其实是-- >
 	for ( ; size-->0 ; dir++) {
 		// 如果p位为0则继续，p位为0即无效表示对应页表不存在
@@ -186,6 +399,8 @@ int free_page_tables(unsigned long from,unsigned long size)
 		for (nr=0 ; nr<1024 ; nr++) {
 			if (1 & *pg_table)                      // p为1则释放
 				free_page(0xfffff000 & *pg_table);  // 其实就是mem_map[]为0
+			else if (*pg_table)			/* swapped out */
+				swap_free(*pg_table >> 1);
 			// 页表项清0
 			*pg_table = 0;
 			pg_table++;
@@ -214,6 +429,11 @@ int free_page_tables(unsigned long from,unsigned long size)
  * doesn't take any more memory - we don't copy-on-write in the low
  * 1 Mb-range, so the pages can be shared with the kernel. Thus the
  * special case for nr=xxxx.
+ *
+ * The page tables are copied from those of from_dir to new ones in
+ * to_dir: the new process has a directory of its own. A page that is
+ * swapped out is read back in for the old process, and the new one
+ * gets its place in swap.
  */
 
 /*
@@ -229,18 +449,18 @@ int free_page_tables(unsigned long from,unsigned long size)
 
 // https://blog.csdn.net/jmh1996/article/details/83515833解析
 
-int copy_page_tables(unsigned long from,unsigned long to,long size)
+int copy_page_tables(unsigned long * from_dir,unsigned long from,
+	unsigned long * to_dir,unsigned long to,long size)
 {
 	unsigned long * from_page_table;
 	unsigned long * to_page_table;
-	unsigned long this_page;
-	unsigned long * from_dir, * to_dir;
+	unsigned long this_page, new_page;
 	unsigned long nr;
 
 	if ((from&0x3fffff) || (to&0x3fffff))
 		panic("copy_page_tables called with wrong alignment");
-	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	to_dir = (unsigned long *) ((to>>20) & 0xffc);
+	from_dir += from>>22;
+	to_dir += to>>22;
 	size = ((unsigned) (size+0x3fffff)) >> 22;
 	for( ; size-->0 ; from_dir++,to_dir++) {
 		if (1 & *to_dir)
@@ -257,8 +477,19 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 		nr = (from==0)?0xA0:1024;
 		for ( ; nr-- > 0 ; from_page_table++,to_page_table++) {
 			this_page = *from_page_table;
-			if (!(1 & this_page))
+			if (!(1 & this_page)) {
+				if (!this_page)
+					continue;
+				if (!(new_page = __get_free_page()))
+					return -1;
+				if (!read_swap_page(this_page>>1,(char *) new_page)) {
+					free_page(new_page);
+					return -1;
+				}
+				*to_page_table = this_page;
+				*from_page_table = new_page | (PAGE_DIRTY | 7);
 				continue;
+			}
 			// 复位页表项中 R/W 标志(置 0)。
 			// (如果 U/S 位是 0，则 R/W 就没有作用。如果 U/S 是 1，而 R/W 是 0，
 			// 那么运行在用户层的代码就只能读页面。如果 U/S 和 R/W 都置位，则就有写的权限。
@@ -281,6 +512,23 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 	return 0;
 }
 
+/*
+ * A page directory for a new process: the kernel's entries are those
+ * of pg_dir, and the page tables they point to are shared by all.
+ */
+unsigned long new_page_dir(void)
+{
+	unsigned long * dir;
+	int i;
+
+	if (!(dir = (unsigned long *) get_free_page()))
+		return 0;
+	for (i=0 ; i<1024 ; i++)
+		if (i < (TASK_BASE>>22) || i >= ((TASK_BASE+TASK_SIZE)>>22))
+			dir[i] = pg_dir[i];
+	return (unsigned long) dir;
+}
+
 /*
  * This function puts a page in memory at the wanted address.
  * It returns the physical address of the page gotten, 0 if
@@ -300,13 +548,11 @@ unsigned long put_page(unsigned long page,unsigned long address)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */
-
 	if (page < LOW_MEM || page >= HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n",page,address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
+	page_table = dir_entry(address);
 	if ((*page_table)&1)
 		page_table = (unsigned long *) (0xfffff000 & *page_table);
 	else {
@@ -320,6 +566,22 @@ unsigned long put_page(unsigned long page,unsigned long address)
 	return page;
 }
 
+/*
+ * The same, for a page the kernel has already filled in (like the
+ * argument pages of exec): it's dirty, as it can't be got back from
+ * anywhere but swap.
+ */
+unsigned long put_dirty_page(unsigned long page,unsigned long address)
+{
+	unsigned long * page_table;
+
+	if (!put_page(page,address))
+		return 0;
+	page_table = (unsigned long *) (0xfffff000 & *dir_entry(address));
+	page_table[(address>>12) & 0x3ff] |= PAGE_DIRTY;
+	return page;
+}
+
 /*
  *取消写保护页面函数。用于页异常中断过程中写保护异常的处理（写时复制）。
  *输入参数为页表项指针。
@@ -337,11 +599,16 @@ void un_wp_page(unsigned long * table_entry)
 		invalidate();
 		return;
 	}
-	if (!(new_page=get_free_page()))
+	if (!(new_page=__get_free_page()))
 		oom();
+/* swap_out() may have taken the page while we slept: fault again */
+	if ((*table_entry & 0xfffff001) != (old_page | 1)) {
+		free_page(new_page);
+		return;
+	}
 	if (old_page >= LOW_MEM)
 		mem_map[MAP_NR(old_page)]--;   // 页面引用次数减一
-	*table_entry = new_page | 7;       // 设置标志位
+	*table_entry = new_page | (PAGE_DIRTY | 7);	/* it's a copy */
 	invalidate();
 	copy_page(old_page,new_page);      // 复制页表内容
 }	
@@ -370,8 +637,7 @@ void do_wp_page(unsigned long error_code,unsigned long address)
 		do_exit(SIGSEGV);
 #endif
 	un_wp_page((unsigned long *)
-		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
+		(((address>>10) & 0xffc) + (0xfffff000 & *dir_entry(address))));
 
 }
 
@@ -384,7 +650,7 @@ void write_verify(unsigned long address)
 {
 	unsigned long page;
     // 判断页目录表项是否存在(检查p位)，不存在则直接返回
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
+	if (!((page = *dir_entry(address)) & 1))
 		return;
 	page &= 0xfffff000;
 	// 计算页表项地址
@@ -415,7 +681,8 @@ void get_empty_page(unsigned long address)
  * task.
  *
  * NOTE! This assumes we have checked that p != current, and that they
- * share the same executable.
+ * share the same executable, and that p isn't running on another cpu:
+ * its page is write-protected, with only our TLB flushed.
  */
 
 /*
@@ -433,14 +700,19 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	unsigned long to_page;
 	unsigned long phys_addr;
 
-	from_page = to_page = ((address>>20) & 0xffc);       // 计算内存地址的页目录项位置
-	from_page += ((p->start_code>>20) & 0xffc);          // 计算程p起始代码页目录项位置 
-	to_page += ((current->start_code>>20) & 0xffc);      // 计算当前进程中起始代码页目录项位置
+	// 计算p和当前进程中该地址的页目录项位置, 各在自己的页目录里
+	from_page = (unsigned long) (page_dir(p) + ((p->start_code+address)>>22));
+	to_page = (unsigned long) (page_dir(current) + ((current->start_code+address)>>22));
+/* share_page() has made sure there is a page table at to */
+	to = *(unsigned long *) to_page;
+	if (!(to & 1))
+		return 0;
 /* is there a page-directory at from? */
 	from = *(unsigned long *) from_page;                 // 计算内存地址页目录项中的内容
 	if (!(from & 1))                                     // 检查p位，若p位为0即无效，直接返回0
 		return 0;
 	from &= 0xfffff000;                                  // 若p位为1则计算出对应页表的基址
+	from_page = from + ((address>>10) & 0xffc);
 	phys_addr = *(unsigned long *) from_page;
 /* is the page clean and present? */
 	if ((phys_addr & 0x41) != 0x01)                      // 判断dirt位和present位，脏或无效则返回0
@@ -449,12 +721,6 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	if (phys_addr >= HIGH_MEMORY || phys_addr < LOW_MEM)
 		return 0;
 /* 下面对当前进程(current)的内存地址进行计算*/		
-	to = *(unsigned long *) to_page;
-	if (!(to & 1))
-		if (to = get_free_page())
-			*(unsigned long *) to_page = to | 7;         // 申请内存后注意更新页目录项指向
-		else
-			oom();
 	to &= 0xfffff000;
 	to_page = to + ((address>>10) & 0xffc);
 	if (1 & *(unsigned long *) to_page)
@@ -477,26 +743,36 @@ static int try_to_share(unsigned long address, struct task_struct * p)
  *
  * We first check if it is at all feasible by checking executable->i_count.
  * It should be >1 if there are other tasks sharing this inode.
+ *
+ * The page table of current is set up before looking at the others:
+ * get_free_page() may sleep (and swap), and nothing may change under
+ * try_to_share().
  */
 static int share_page(unsigned long address)
 {
-	struct task_struct ** p;
+	struct task_struct * p;
+	unsigned long * dir, tmp;
 
 	if (!current->executable)                         // 如果进程是不可执行的，则直接返回
 		return 0;
-	if (current->executable->i_count < 2)             // 如果进程只能单独执行，也直接返回
+	if (atomic_read(&current->executable->i_count) < 2)             // 如果进程只能单独执行，也直接返回
 		return 0;
-	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-		// 空闲进程不满足要求
-		if (!*p)
-			continue;
+	dir = dir_entry(current->start_code + address);
+	if (!(*dir & 1))
+		if (tmp = get_free_page())
+			*dir = tmp | 7;
+		else
+			oom();
+	for_each_task(p) {
 		// 当前进程不满足要求
-		if (current == *p)
+		if (current == p)
 			continue;
 		// executable不等不满足要求
-		if ((*p)->executable != current->executable)
+		if (p->executable != current->executable)
 			continue;
-		if (try_to_share(address,*p))
+		if (running_elsewhere(p))
+			continue;
+		if (try_to_share(address,p))
 			return 1;
 	}
 	return 0;
@@ -516,7 +792,7 @@ void do_no_page(unsigned long error_code,unsigned long address)
 {
 	int nr[4];
 	unsigned long tmp;
-	unsigned long page;
+	unsigned long page, * table;
 	int block,i;
 
     // 计算address对应的页首地址，即减去最后12位的偏移地址
@@ -529,6 +805,14 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	 *tmp > end_data说明是访问堆或者栈的空间时发生的缺页
      *因此就直接调用 get_empty_page()函数，申请一页物理内存并映射到指定线性地址处即可。
 	 */
+	page = *dir_entry(address);
+	if (page & 1) {
+		table = (unsigned long *) (page & 0xfffff000) + ((address>>12) & 0x3ff);
+		if (*table && !(*table & 1)) {	/* swapped out */
+			swap_in(table);
+			return;
+		}
+	}
 	if (!current->executable || tmp >= current->end_data) {
 		get_empty_page(address);
 		return;
@@ -536,7 +820,8 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	// 是否有进程已经使用
 	if (share_page(tmp))
 		return;
-	if (!(page = get_free_page()))
+/* bread_page() fills all of it, clearing what it can't read */
+	if (!(page = __get_free_page()))
 		oom();
 /* remember that 1 block is used for header（程序头需要使用一个block） */
 	/*
@@ -569,21 +854,35 @@ void do_no_page(unsigned long error_code,unsigned long address)
  *物理内存初始化。
  *start_mem - 可用作分页处理的物理内存起始位置（已去除 RAMDISK 所占内存空间等）。
  *end_mem - 实际物理内存最大地址。
- *在该版的 Linux 内核中，最多能使用 16Mb 的内存，大于 16Mb 的内存将不于考虑，弃置不用。
  *0 - 1Mb 内存空间用于内核系统（其实是 0-640Kb）。
+ *
+ * end_mem may be up to 64MB (see main()), all of which boot/head.s has
+ * mapped. mem_map[] and free_order[] take the first pages of main
+ * memory, one byte each for every page above LOW_MEM.
  */ 
 void mem_init(long start_mem, long end_mem)
 {
 	int i;
 
 	HIGH_MEMORY = end_mem;               // HIGH_MEMORY初始化是为0的
-	for (i=0 ; i<PAGING_PAGES ; i++)
+	paging_pages = MAP_NR(end_mem);
+	mem_map = (unsigned char *) start_mem;
+	free_order = mem_map + paging_pages;
+	start_mem = PAGE_ALIGN((long) (free_order + paging_pages));
+	for (i=0 ; i<NR_MEM_LISTS ; i++)
+		free_area[i].next = free_area[i].prev = free_area+i;
+	for (i=0 ; i<paging_pages ; i++) {
 		mem_map[i] = USED;
+		free_order[i] = 0;
+	}
 	i = MAP_NR(start_mem);
 	end_mem -= start_mem;
 	end_mem >>= 12;
-	while (end_mem-->0)
-		mem_map[i++]=0;
+	mem_stats.ms_total = end_mem;
+	while (end_mem-->0) {
+		mem_map[i]=0;
+		free_pages_ok(i++,0);
+	}
 }
 
 
@@ -593,13 +892,13 @@ void calc_mem(void)
 	int i,j,k,free=0;                   // free即空闲页面数
 	long * pg_tbl;
 
-	for(i=0 ; i<PAGING_PAGES ; i++)
+	for(i=0 ; i<paging_pages ; i++)
 		if (!mem_map[i]) free++;
-	printk("%d pages free (of %d)\n\r",free,PAGING_PAGES);
-	// 扫描所有页目录项（除 0，1 项），如果页目录项有效，则统计对应页表中有效页面数，并显示。
-	for(i=2 ; i<1024 ; i++) {
-		if (1&pg_dir[i]) {
-			pg_tbl=(long *) (0xfffff000 & pg_dir[i]);
+	printk("%d pages free (of %d)\n\r",free,paging_pages);
+	// 扫描当前进程的页目录项，如果页目录项有效，则统计对应页表中有效页面数，并显示。
+	for(i=TASK_BASE>>22 ; i<(TASK_BASE+TASK_SIZE)>>22 ; i++) {
+		if (1&page_dir(current)[i]) {
+			pg_tbl=(long *) (0xfffff000 & page_dir(current)[i]);
 			for(j=k=0 ; j<1024 ; j++)
 				if (pg_tbl[j]&1)
 					k++;
@@ -25,12 +25,14 @@ _page_fault:
 	movl %cr2,%edx
 	pushl %edx
 	pushl %eax
-	testl $1,%eax
+	call _lock_kernel
+	testl $1,(%esp)
 	jne 1f
 	call _do_no_page
 	jmp 2f
 1:	call _do_wp_page
-2:	addl $8,%esp
+2:	call _unlock_kernel
+	addl $8,%esp
 	pop %fs
 	pop %es
 	pop %ds
@@ -0,0 +1,384 @@
+/*
+ *  linux/mm/swap.c
+ */
+
+/*
+ * Swapping, to the block device or file given to swapon(). Its first
+ * page is a bitmap of the pages in it that may be used, ending in the
+ * signature "SWAP-SPACE" (page 0 itself never is). Pages go out and
+ * back in through the buffer cache, four blocks at a time: for a file
+ * the blocks bmap() finds, so it mustn't have holes.
+ *
+ * The page table entry of a page in swap is the number of its page
+ * there shifted left one: not present, but not 0 either, which is how
+ * do_no_page() knows to call swap_in(). Only pages nobody else has are
+ * written out. Clean ones are just dropped, as do_no_page() gets them
+ * back from the executable (or as zeroes) like the first time.
+ *
+ * swap_out() picks a page with the clock algorithm: the hand goes
+ * round the page tables of all processes, and a page that has been
+ * accessed since it last came by gets a second chance (the accessed
+ * bit is cleared). It is called from get_free_page() when memory runs
+ * low (see mm/memory.c), so it may sleep on behalf of whoever wants a
+ * page - except for the idle tasks, which mustn't.
+ */
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/memstat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+
+#define SWAP_BITS (4096<<3)
+
+#define bit(map,nr) (((map)[(nr)>>3] >> ((nr)&7)) & 1)
+#define setbit(map,nr) ((map)[(nr)>>3] |= 1 << ((nr)&7))
+#define clrbit(map,nr) ((map)[(nr)>>3] &= ~(1 << ((nr)&7)))
+
+extern struct memstat mem_stats;
+
+volatile void do_exit(long code);
+
+static unsigned char * swap_bitmap = NULL;
+static int swap_lowest = 1;		/* no free swap page below this */
+static int swap_dev = 0;
+static struct m_inode * swap_file = NULL;
+
+/* only one page goes to or from swap at a time */
+static int swap_locked = 0;
+static struct wait_queue * swap_wait = NULL;
+
+static void lock_swap(void)
+{
+	while (swap_locked)
+		sleep_on(&swap_wait);
+	swap_locked = 1;
+}
+
+static void unlock_swap(void)
+{
+	swap_locked = 0;
+	wake_up(&swap_wait);
+}
+
+/*
+ * The blocks of page nr of swap. Returns 0 if the swap file has a
+ * hole there.
+ */
+static int swap_blocks(int nr, int * b)
+{
+	int i;
+
+	for (i=0 ; i<4 ; i++) {
+		b[i] = nr*4+i;
+		if (swap_file && !(b[i] = bmap(swap_file,b[i])))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Returns 0 if the page couldn't be read: what of it couldn't is
+ * cleared.
+ */
+int read_swap_page(int nr, char * buffer)
+{
+	int b[4], ok = 0;
+
+	lock_swap();
+	if (swap_blocks(nr,b))
+		ok = bread_page((unsigned long) buffer,swap_dev,b);
+	else {
+		printk("read_swap_page: no blocks for page %d\n\r",nr);
+		memset(buffer,0,PAGE_SIZE);
+	}
+	unlock_swap();
+	if (!ok)
+		printk("read_swap_page: unable to read page %d\n\r",nr);
+	return ok;
+}
+
+/*
+ * Called with the swap lock held. The data is in the buffers when this
+ * returns 1; 0 means page nr has no blocks, and nothing was copied.
+ */
+static int write_swap_page(int nr, char * buffer)
+{
+	struct buffer_head * bh;
+	int b[4], i;
+
+	if (!swap_blocks(nr,b)) {
+		printk("write_swap_page: no blocks for page %d\n\r",nr);
+		return 0;
+	}
+	for (i=0 ; i<4 ; i++,buffer += BLOCK_SIZE) {
+		if (!(bh = getblk(swap_dev,b[i])))
+			panic("write_swap_page: getblk returned NULL");
+		memcpy(bh->b_data,buffer,BLOCK_SIZE);
+		bh->b_uptodate = 1;
+		bh->b_dirt = 1;
+		ll_rw_block(WRITE,bh);
+		brelse(bh);
+	}
+	return 1;
+}
+
+/*
+ * swap_lowest saves going over the start of the bitmap each time, and
+ * bytes with no free page in them are skipped whole.
+ */
+static int get_swap_page(void)
+{
+	int nr;
+
+	for (nr=swap_lowest ; nr<SWAP_BITS ; nr++) {
+		if (!swap_bitmap[nr>>3]) {
+			nr |= 7;
+			continue;
+		}
+		if (bit(swap_bitmap,nr)) {
+			clrbit(swap_bitmap,nr);
+			swap_lowest = nr+1;
+			mem_stats.ms_swap_free--;
+			return nr;
+		}
+	}
+	swap_lowest = SWAP_BITS;
+	return 0;
+}
+
+void swap_free(int nr)
+{
+	if (!swap_bitmap || nr <= 0 || nr >= SWAP_BITS) {
+		printk("swap_free: bad swap page %d\n\r",nr);
+		return;
+	}
+	if (bit(swap_bitmap,nr)) {
+		printk("swap_free: swap page %d already free\n\r",nr);
+		return;
+	}
+	setbit(swap_bitmap,nr);
+	if (nr < swap_lowest)
+		swap_lowest = nr;
+	mem_stats.ms_swap_free++;
+}
+
+/*
+ * Called from do_no_page() for the entry of a page that is in swap.
+ * The page is only ours, so nobody can change the entry meanwhile. If
+ * it can't be read back the process dies: the entry is left as it is,
+ * for exit to free.
+ */
+void swap_in(unsigned long * table_ptr)
+{
+	unsigned long page;
+	int nr;
+
+	if (!swap_bitmap) {
+		printk("swap_in: no swap space\n\r");
+		do_exit(SIGSEGV);
+	}
+	nr = *table_ptr >> 1;
+	if (!(page = __get_free_page())) {
+		printk("out of memory\n\r");
+		do_exit(SIGSEGV);
+	}
+	if (!read_swap_page(nr,(char *) page)) {
+		free_page(page);
+		do_exit(SIGSEGV);
+	}
+	*table_ptr = page | (PAGE_DIRTY | 7);
+	swap_free(nr);
+	mem_stats.ms_swap_ins++;
+}
+
+static unsigned long * page_entry(struct task_struct * p, unsigned long address)
+{
+	unsigned long dir = page_dir(p)[address>>22];
+
+	if (!(dir & PAGE_PRESENT))
+		return NULL;
+	return (unsigned long *) (dir & 0xfffff000) + ((address>>12) & 0x3ff);
+}
+
+/*
+ * Frees the page at address in task nr if it can: returns 1 if it did.
+ * A page is only written out if no one else has it. Writing it sleeps
+ * with the page still mapped, so afterwards we make sure it's still
+ * there, unchanged and not accessed, before the entry is changed.
+ */
+static int try_to_swap_out(int nr_task, unsigned long address)
+{
+	struct task_struct * p = task[nr_task];
+	unsigned long page, entry, * table_ptr;
+	long pid = p->pid;
+	int nr;
+
+	table_ptr = page_entry(p,address);
+	entry = *table_ptr;
+	page = entry & 0xfffff000;
+	if (page < LOW_MEM || page >= HIGH_MEMORY)
+		return 0;
+	if (!(entry & PAGE_DIRTY)) {
+		*table_ptr = 0;
+		invalidate();
+		free_page(page);
+		mem_stats.ms_swap_drops++;
+		return 1;
+	}
+	if (mem_map[MAP_NR(page)] != 1)
+		return 0;
+	if (!(nr = get_swap_page()))
+		return 0;
+	if (!write_swap_page(nr,(char *) page)) {
+		swap_free(nr);
+		return 0;
+	}
+	if (task[nr_task] != p || p->pid != pid || p->state == TASK_ZOMBIE ||
+	    running_elsewhere(p) || !(table_ptr = page_entry(p,address)) ||
+	    *table_ptr != entry || mem_map[MAP_NR(page)] != 1) {
+		swap_free(nr);
+		return 0;
+	}
+	*table_ptr = nr << 1;
+	invalidate();
+	free_page(page);
+	mem_stats.ms_swap_outs++;
+	return 1;
+}
+
+/*
+ * Moves the clock hand (a task, and an address in it) on until a page
+ * has been freed, and returns 1; or 0 if going round twice didn't find
+ * one, or there is no swap space. Processes running on other cpus are
+ * left alone (see running_elsewhere()).
+ */
+int swap_out(void)
+{
+	static int task_nr = 1;
+	static unsigned long address = TASK_BASE;
+	struct task_struct * p;
+	unsigned long * table;
+	int rounds;
+
+	if (!swap_bitmap || is_idle(current))
+		return 0;
+	lock_swap();
+	for (rounds = 2*NR_TASKS ; rounds > 0 ; rounds--) {
+		p = task[task_nr];
+		if (p && p->state != TASK_ZOMBIE && !running_elsewhere(p))
+			for ( ; address < TASK_BASE+TASK_SIZE ; address += PAGE_SIZE) {
+				if (!(table = page_entry(p,address))) {
+					address |= 0x3ff000;	/* next page table */
+					continue;
+				}
+				if (!(*table & PAGE_PRESENT))
+					continue;
+				if (*table & PAGE_ACCESSED) {
+					*table &= ~PAGE_ACCESSED;
+					if (p->tss.cr3 == current->tss.cr3)
+						invalidate();	/* fork's child has ours */
+					continue;
+				}
+				if (try_to_swap_out(task_nr,address)) {
+					address += PAGE_SIZE;
+					unlock_swap();
+					return 1;
+				}
+				if (task[task_nr] != p || p->state == TASK_ZOMBIE ||
+				    running_elsewhere(p))
+					break;		/* changed while we slept */
+			}
+		address = TASK_BASE;
+		if (++task_nr >= NR_TASKS)
+			task_nr = 1;
+	}
+	unlock_swap();
+	return 0;
+}
+
+/*
+ * Starts swapping to specialfile, a block device or a regular file,
+ * which must have the swap signature. There can only be one.
+ */
+int sys_swapon(const char * specialfile)
+{
+	struct m_inode * inode;
+	struct buffer_head * bh;
+	unsigned char * map;
+	int i, j, b[4];
+
+	if (!suser())
+		return -EPERM;
+	lock_swap();
+	if (swap_bitmap) {
+		unlock_swap();
+		return -EBUSY;
+	}
+	if (!(inode = namei(specialfile))) {
+		unlock_swap();
+		return -ENOENT;
+	}
+	if (S_ISBLK(inode->i_mode)) {
+		swap_dev = inode->i_zone[0];
+		iput(inode);
+		inode = NULL;
+	} else if (S_ISREG(inode->i_mode))
+		swap_dev = inode->i_dev;
+	else {
+		iput(inode);
+		unlock_swap();
+		return -EINVAL;
+	}
+	swap_file = inode;
+	if (!(map = (unsigned char *) get_free_page())) {
+		i = -ENOMEM;
+		goto bad;
+	}
+	for (i=0 ; i<4 ; i++) {
+		j = i;
+		if (swap_file && !(j = bmap(swap_file,i)))
+			break;
+		if (!(bh = bread(swap_dev,j)))
+			break;
+		memcpy(map+i*BLOCK_SIZE,bh->b_data,BLOCK_SIZE);
+		brelse(bh);
+	}
+	if (i < 4 || strncmp("SWAP-SPACE",(char *) map+4086,10)) {
+		printk("Unable to find swap-space signature\n\r");
+		free_page((unsigned long) map);
+		i = -EINVAL;
+		goto bad;
+	}
+	memset(map+4086,0,10);
+	clrbit(map,0);
+	for (i=1,j=0 ; i<SWAP_BITS ; i++)
+		if (bit(map,i)) {
+			if (swap_blocks(i,b))
+				j++;
+			else
+				clrbit(map,i);
+		}
+	if (!j) {
+		printk("Empty swap-file\n\r");
+		free_page((unsigned long) map);
+		i = -EINVAL;
+		goto bad;
+	}
+	printk("Adding swap: %d pages (%d bytes) swap-space\n\r",j,j*4096);
+	mem_stats.ms_swap_total = mem_stats.ms_swap_free = j;
+	swap_lowest = 1;
+	swap_bitmap = map;
+	unlock_swap();
+	return 0;
+bad:
+	if (swap_file)
+		iput(swap_file);
+	swap_file = NULL;
+	swap_dev = 0;
+	unlock_swap();
+	return i;
+}